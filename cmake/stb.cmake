@@ -0,0 +1,14 @@
+# For stb_image and stb_image_write. glwx compiles its own copy of stb_image, but does not expose
+# its headers, so we get our own. stb has no releases, so this is pinned to a commit on master.
+FetchContent_Declare(
+    stb
+    GIT_REPOSITORY https://github.com/nothings/stb.git
+    GIT_TAG 5736b15f7ea0ffb08dd38af21067c314d6a3aae9
+)
+FetchContent_MakeAvailable(stb)
+
+FetchContent_GetProperties(stb SOURCE_DIR STB_SOURCE_DIR)
+
+# Header-only. The implementations are compiled (as static functions) in image.cpp.
+add_library(stb_headers INTERFACE)
+target_include_directories(stb_headers SYSTEM INTERFACE ${STB_SOURCE_DIR})
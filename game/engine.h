@@ -14,12 +14,197 @@ typedef long i64;
 typedef u64 usize;
 typedef u64 timestamp_t;
 
+typedef struct {
+    float x, y, scale;
+    float r, g, b, a;
+} SpriteInstance;
+
+typedef struct {
+    u32 image_handle;
+    SpriteInstance sprite;
+} MixedSpriteInstance;
+
 void* ng_alloc(usize size);
+
+// How memory from ng_alloc_ex is treated by the snapshots
+enum {
+    NG_VOLATILE = 0, // saved every frame, like ng_alloc
+    // Never saved. Fill it in the update/render call (usually load) you allocate it in, after that
+    // it's read-only and writing to it is a fault. Use this for level data, lookup tables, etc.
+    NG_IMMUTABLE = 1,
+    // Never saved or restored, so it keeps its contents when seeking or replaying. Use this for
+    // caches that can always be rebuilt.
+    NG_TRANSIENT = 2,
+};
+
+void* ng_alloc_ex(usize size, u32 flags);
+// Temporary memory that is freed before the next update/render call. It is not zeroed and it is
+// not part of the snapshots, so never keep pointers to it in your state.
+void* ng_frame_alloc(usize size);
+// Loading the same path again returns the same handle. At most 16 images can be loaded.
 u32 ng_load_image(const char* path);
 void ng_draw_sprite(
     u32 image_handle, float x, float y, float scale, float r, float g, float b, float a);
+// Draw many sprites with a single call. Prefer these if you draw a lot of sprites.
+void ng_draw_sprites(u32 image_handle, const SpriteInstance* instances, usize count);
+// Consecutive instances with the same image are submitted together, so sort them if you can.
+void ng_draw_sprites_mixed(const MixedSpriteInstance* instances, usize count);
+// Sprites are drawn sorted by layer (0 to 65535, lowest first), so they can be batched. Within a
+// layer the draw order is only kept for sprites in the same atlas page, so if sprites must overlap
+// a certain way, put them on different layers. Every render starts on layer 0.
+void ng_set_layer(u32 layer);
+// Fonts are TrueType files. size is the line height in pixels (at most 128). Load them in load,
+// like images. Loading the same file with the same size again returns the same handle.
+u32 ng_load_font(const char* path, float size);
+// Draws UTF-8 text with the top left of the first line at (x, y) on the current layer. '\n' starts
+// a new line. Glyphs are cached, so drawing the same text every frame is cheap.
+void ng_draw_text(u32 font, const char* str, float x, float y, float r, float g, float b, float a);
+// The width in pixels of the widest line, e.g. to right-align text
+float ng_measure_text(u32 font, const char* str);
+// These look up the key by name every call. Prefer the _id variants below.
 bool ng_is_key_down(const char* key);
+int ng_key_pressed(const char* key);
+
+// Key handles are SDL scancodes, so they are stable and the constants below can be used directly.
+// Other keys can be looked up by name once (e.g. in load) with ng_key. 0 means unknown key.
+enum {
+    NG_KEY_A = 4,
+    NG_KEY_B,
+    NG_KEY_C,
+    NG_KEY_D,
+    NG_KEY_E,
+    NG_KEY_F,
+    NG_KEY_G,
+    NG_KEY_H,
+    NG_KEY_I,
+    NG_KEY_J,
+    NG_KEY_K,
+    NG_KEY_L,
+    NG_KEY_M,
+    NG_KEY_N,
+    NG_KEY_O,
+    NG_KEY_P,
+    NG_KEY_Q,
+    NG_KEY_R,
+    NG_KEY_S,
+    NG_KEY_T,
+    NG_KEY_U,
+    NG_KEY_V,
+    NG_KEY_W,
+    NG_KEY_X,
+    NG_KEY_Y,
+    NG_KEY_Z,
+    NG_KEY_1,
+    NG_KEY_2,
+    NG_KEY_3,
+    NG_KEY_4,
+    NG_KEY_5,
+    NG_KEY_6,
+    NG_KEY_7,
+    NG_KEY_8,
+    NG_KEY_9,
+    NG_KEY_0,
+    NG_KEY_RETURN,
+    NG_KEY_ESCAPE,
+    NG_KEY_BACKSPACE,
+    NG_KEY_TAB,
+    NG_KEY_SPACE,
+    NG_KEY_RIGHT = 79,
+    NG_KEY_LEFT,
+    NG_KEY_DOWN,
+    NG_KEY_UP,
+    NG_KEY_LCTRL = 224,
+    NG_KEY_LSHIFT,
+    NG_KEY_LALT,
+    NG_KEY_RCTRL = 228,
+    NG_KEY_RSHIFT,
+    NG_KEY_RALT,
+};
+
+int ng_key(const char* name);
+bool ng_is_key_down_id(int key);
+int ng_key_pressed_id(int key);
 float ng_randomf();
+
+// Pools store up to `capacity` entities as one dense array per component (structure of arrays),
+// so loops over a component only touch that component. Create them in load, like ng_alloc.
+// Removing an entity moves the last one into its place, so indices are not stable. If you need to
+// refer to entities, keep an id component.
+typedef struct Pool Pool;
+
+// component_sizes[i] is the size of one element of component i (at most 16 components)
+Pool* ng_pool_create(u32 capacity, const u32* component_sizes, u32 num_components);
+// Returns the index of the new entity, all components are zeroed
+u32 ng_pool_add(Pool* pool);
+// Returns the index the last entity was moved from (which is the new count)
+u32 ng_pool_remove(Pool* pool, u32 index);
+u32 ng_pool_count(const Pool* pool);
+// The array of a component, indexed by entity. It's aligned to 64 bytes.
+void* ng_pool_component(Pool* pool, u32 component);
+
+// Tilemaps draw a grid of tiles from a tileset image. Tiles are numbered row by row through the
+// tileset starting at 1, 0 is empty. The geometry is cached in chunks of 16x16 tiles and only
+// rebuilt when a tile in the chunk changes, so drawing a static level is cheap. Create them in
+// load, like ng_alloc.
+typedef struct Tilemap Tilemap;
+
+// tile_size is in pixels, width and height are in tiles. All tiles start out empty.
+Tilemap* ng_tilemap_create(u32 image_handle, u32 tile_size, u32 width, u32 height);
+void ng_tilemap_set(Tilemap* map, u32 x, u32 y, u32 tile);
+u32 ng_tilemap_get(const Tilemap* map, u32 x, u32 y);
+// Draws the map with its top left corner at (x, y) on the current layer
+void ng_tilemap_draw(const Tilemap* map, float x, float y);
+
+// A uniform grid for neighbor queries. It is not part of the snapshots, so rebuild it (clear and
+// insert everything) in the same update/render call you query it in.
+// cell_size should be about the size of your typical query radius (and positive).
+void ng_spatial_clear(float cell_size);
+void ng_spatial_insert(u32 id, float x, float y);
+// Writes at most `capacity` ids of entries within `radius` to `out_ids` and returns the total
+// number of entries found (which might be larger than `capacity`). radius must not be negative.
+usize ng_spatial_query_radius(float x, float y, float radius, u32* out_ids, usize capacity);
+// Bulk operations over arrays, implemented natively and vectorized. Keep your hot data as separate
+// arrays per component (x[], y[], ...) to use them.
+// x += vx * dt, y += vy * dt
+void ng_bulk_integrate(float* x, float* y, const float* vx, const float* vy, usize count, float dt);
+// out = distance of (x, y) to (px, py)
+void ng_bulk_distance(const float* x, const float* y, usize count, float px, float py, float* out);
+void ng_bulk_clamp(float* values, usize count, float min, float max);
+// out = a + (b - a) * t
+void ng_bulk_lerp(const float* a, const float* b, usize count, float t, float* out);
+// out = 1 if (x, y) is within radius of (cx, cy), 0 otherwise. Returns the number of points inside.
+usize ng_bulk_circle_contains(
+    float cx, float cy, float radius, const float* x, const float* y, usize count, u8* out);
+
+typedef struct {
+    u64 state;
+} RandomState;
+
+float ng_randomf_r(RandomState* rng);
+
+// The n-th value of a stream only depends on the session seed, the stream id and n, so unlike
+// ng_randomf, adding or reordering calls elsewhere does not change what a stream produces.
+// Keep the streams in your state, so they are part of the snapshots.
+typedef struct {
+    u64 key;
+    u64 counter;
+} RandomStream;
+
+RandomStream ng_random_stream(u64 id);
+float ng_randomf_stream(RandomStream* stream);
+// Same as calling ng_randomf_stream `count` times, but much faster
+void ng_random_fill(RandomStream* stream, float* out, usize count);
+
+// Calls fn(ctx, i, rng) for every i in [0, count) on all cores, in chunks of `grain` indices. Use a
+// grain that makes a chunk take at least a few microseconds.
+// Every index gets its own random stream in `rng`, so as long as fn only writes data belonging to
+// index i, the results are the same no matter how the work was distributed.
+// Only ng_frame_alloc, the input functions, the random stream functions, ng_randomf_r,
+// ng_spatial_query_radius and ng_bulk_* may be called from fn. If fn breaks (or errors, faults,
+// ...), the break with the lowest index is passed on to the caller.
+void ng_parallel_for(
+    usize count, usize grain, void (*fn)(void* ctx, usize index, RandomState* rng), void* ctx);
+
 void ng_break_internal(const char* file, int line);
 timestamp_t ng_timestamp_internal(const char* file, int line);
 void ng_error_internal(const char* file, int line, const char* msg);
@@ -67,8 +67,8 @@ void* load()
 void update(State* state, float t, float dt)
 {
     // Update player
-    const int move_x = ng_is_key_down("d") - ng_is_key_down("a");
-    const int move_y = ng_is_key_down("s") - ng_is_key_down("w");
+    const int move_x = ng_is_key_down_id(NG_KEY_D) - ng_is_key_down_id(NG_KEY_A);
+    const int move_y = ng_is_key_down_id(NG_KEY_S) - ng_is_key_down_id(NG_KEY_W);
     const float player_speed = 300.0f;
 
     state->player.pos.x += move_x * player_speed * dt;
@@ -120,29 +120,40 @@ void render(const State* state)
     ng_draw_sprite(state->player.sprite, state->player.pos.x, state->player.pos.y, 1.0f, 1.0f, 1.0f,
         1.0f, 1.0f);
 
-    // Draw chickens
+    // Draw chickens. Circles first, then chickens, so they can be submitted in two runs.
+    MixedSpriteInstance sprites[32];
+    usize num_circles = 0;
     for (int i = 0; i < state->num_chickens; i++) {
         const Chicken* c = &state->chickens[i];
         if (!c->alive)
             continue;
 
+        MixedSpriteInstance* s = &sprites[num_circles++];
+        s->image_handle = state->debug_circle_sprite;
+        s->sprite = (SpriteInstance) { c->pos.x, c->pos.y, CHIK_EAT_RADIUS / 128.0f, 0.0f, 1.0f,
+            0.0f, 0.25f };
         if (!c->is_friendly) {
-            const float scale = CHIK_AGGRO_RADIUS / 128.0f;
-            ng_draw_sprite(
-                state->debug_circle_sprite, c->pos.x, c->pos.y, scale, 1.0f, 0.0f, 0.0f, 0.25f);
-        } else {
-            const float scale = CHIK_EAT_RADIUS / 128.0f;
-            ng_draw_sprite(
-                state->debug_circle_sprite, c->pos.x, c->pos.y, scale, 0.0f, 1.0f, 0.0f, 0.25f);
+            s->sprite.scale = CHIK_AGGRO_RADIUS / 128.0f;
+            s->sprite.r = 1.0f;
+            s->sprite.g = 0.0f;
         }
+    }
+
+    usize num_sprites = num_circles;
+    for (int i = 0; i < state->num_chickens; i++) {
+        const Chicken* c = &state->chickens[i];
+        if (!c->alive)
+            continue;
 
         // Green for friendly, red for angry
+        MixedSpriteInstance* s = &sprites[num_sprites++];
+        s->image_handle = c->sprite;
         if (c->is_friendly) {
-            ng_draw_sprite(c->sprite, c->pos.x, c->pos.y, 1.0f, 0.8f, 1.0f, 0.8f, 1.0f);
+            s->sprite = (SpriteInstance) { c->pos.x, c->pos.y, 1.0f, 0.8f, 1.0f, 0.8f, 1.0f };
         } else {
-            float r = 1.0f;
-            float gb = 1.0f - c->anger;
-            ng_draw_sprite(c->sprite, c->pos.x, c->pos.y, 1.0f, r, gb, gb, 1.0f);
+            const float gb = 1.0f - c->anger;
+            s->sprite = (SpriteInstance) { c->pos.x, c->pos.y, 1.0f, 1.0f, gb, gb, 1.0f };
         }
     }
+    ng_draw_sprites_mixed(sprites, num_sprites);
 }
@@ -0,0 +1,113 @@
+#include "atlas.hpp"
+
+#include <cassert>
+#include <memory>
+#include <vector>
+
+// imgui_draw.cpp has its own static copy, so this does not collide
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+
+// stb_rect_pack packs incrementally, but it can't free anything, so freed regions go into a list
+// and are reused for images that fit into them.
+struct Page {
+    stbrp_context context;
+    std::vector<stbrp_node> nodes;
+};
+
+struct Atlas {
+    std::vector<std::unique_ptr<Page>> pages; // the context points into nodes, so they can't move
+    std::vector<atlas::Region> free_regions;
+
+    static Atlas& instance()
+    {
+        static Atlas atlas;
+        return atlas;
+    }
+};
+
+static atlas::Region make_region(
+    uint32_t page, uint32_t slot_x, uint32_t slot_y, uint32_t slot_w, uint32_t slot_h)
+{
+    return atlas::Region { page, slot_x + atlas::Padding, slot_y + atlas::Padding,
+        slot_w - 2 * atlas::Padding, slot_h - 2 * atlas::Padding, slot_x, slot_y, slot_w,
+        slot_h };
+}
+
+static std::optional<atlas::Region> reuse_free(Atlas& atlas, uint32_t slot_w, uint32_t slot_h)
+{
+    // Best fit by area, so large slots stay available for large images
+    size_t best = atlas.free_regions.size();
+    uint64_t best_area = UINT64_MAX;
+    for (size_t i = 0; i < atlas.free_regions.size(); ++i) {
+        const auto& r = atlas.free_regions[i];
+        const auto area = static_cast<uint64_t>(r.slot_width) * r.slot_height;
+        if (r.slot_width >= slot_w && r.slot_height >= slot_h && area < best_area) {
+            best = i;
+            best_area = area;
+        }
+    }
+    if (best == atlas.free_regions.size()) {
+        return std::nullopt;
+    }
+    auto region = atlas.free_regions[best];
+    atlas.free_regions.erase(atlas.free_regions.begin() + static_cast<ptrdiff_t>(best));
+    region.width = slot_w - 2 * atlas::Padding;
+    region.height = slot_h - 2 * atlas::Padding;
+    return region;
+}
+
+static bool pack(Page& page, uint32_t slot_w, uint32_t slot_h, stbrp_rect& rect)
+{
+    rect = stbrp_rect {};
+    rect.w = static_cast<stbrp_coord>(slot_w);
+    rect.h = static_cast<stbrp_coord>(slot_h);
+    return stbrp_pack_rects(&page.context, &rect, 1) && rect.was_packed;
+}
+
+namespace atlas {
+std::optional<Region> allocate(uint32_t width, uint32_t height)
+{
+    auto& atlas = Atlas::instance();
+    const auto slot_w = width + 2 * Padding;
+    const auto slot_h = height + 2 * Padding;
+    if (slot_w > PageSize || slot_h > PageSize) {
+        return std::nullopt;
+    }
+
+    if (auto region = reuse_free(atlas, slot_w, slot_h)) {
+        return region;
+    }
+
+    stbrp_rect rect;
+    for (size_t p = 0; p < atlas.pages.size(); ++p) {
+        if (pack(*atlas.pages[p], slot_w, slot_h, rect)) {
+            return make_region(static_cast<uint32_t>(p), static_cast<uint32_t>(rect.x),
+                static_cast<uint32_t>(rect.y), slot_w, slot_h);
+        }
+    }
+
+    if (atlas.pages.size() >= MaxNumPages) {
+        return std::nullopt;
+    }
+    auto& page = *atlas.pages.emplace_back(std::make_unique<Page>());
+    page.nodes.resize(PageSize);
+    stbrp_init_target(&page.context, static_cast<int>(PageSize), static_cast<int>(PageSize),
+        page.nodes.data(), static_cast<int>(page.nodes.size()));
+    [[maybe_unused]] const auto packed = pack(page, slot_w, slot_h, rect);
+    assert(packed);
+    return make_region(static_cast<uint32_t>(atlas.pages.size() - 1),
+        static_cast<uint32_t>(rect.x), static_cast<uint32_t>(rect.y), slot_w, slot_h);
+}
+
+void free(const Region& region)
+{
+    Atlas::instance().free_regions.push_back(region);
+}
+
+size_t get_num_pages()
+{
+    return Atlas::instance().pages.size();
+}
+}
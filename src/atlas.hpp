@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Packs images into a few large texture pages, so sprites with different images can be drawn in
+// the same batch. This only does the bookkeeping, the pages themselves are textures in gfx.
+namespace atlas {
+constexpr uint32_t PageSize = 2048;
+constexpr uint32_t MaxNumPages = 8;
+// Empty space around every image, so filtering does not bleed neighbors into it
+constexpr uint32_t Padding = 1;
+
+struct Region {
+    uint32_t page;
+    // The image itself
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    // The space reserved for it (including padding), which might be larger if it was reused
+    uint32_t slot_x;
+    uint32_t slot_y;
+    uint32_t slot_width;
+    uint32_t slot_height;
+};
+
+// Packs into existing pages first (reusing freed regions) and adds a page if nothing fits.
+// Returns nullopt if the image is larger than a page or all pages are full.
+std::optional<Region> allocate(uint32_t width, uint32_t height);
+// The region may be reused by later allocations
+void free(const Region& region);
+size_t get_num_pages();
+}
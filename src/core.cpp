@@ -1,9 +1,7 @@
 #include "core.hpp"
-#include "glwx/texture.hpp"
 
-#include <memory>
+#include <cassert>
 
-#include <glwx/spriterenderer.hpp>
 #include <glwx/window.hpp>
 
 #include "imgui.h"
@@ -45,12 +43,24 @@ void shutdown()
 
 bool InputState::is_down(const char* key)
 {
-    return keyboard_state[static_cast<size_t>(get_scancode(key))];
+    return is_down(get_scancode(key));
 }
 
 bool InputState::is_pressed(const char* key)
 {
-    return keyboard_pressed[static_cast<size_t>(get_scancode(key))];
+    return is_pressed(get_scancode(key));
+}
+
+bool InputState::is_down(int scancode)
+{
+    assert(scancode >= 0 && static_cast<size_t>(scancode) < MaxNumScancodes);
+    return keyboard_state[static_cast<size_t>(scancode)];
+}
+
+bool InputState::is_pressed(int scancode)
+{
+    assert(scancode >= 0 && static_cast<size_t>(scancode) < MaxNumScancodes);
+    return keyboard_pressed[static_cast<size_t>(scancode)];
 }
 
 int get_scancode(const char* name)
@@ -111,80 +121,19 @@ float get_perf_counter_elapsed(uint64_t start, uint64_t factor)
     const auto delta = get_perf_counter() - start;
     return static_cast<float>(delta * factor) / static_cast<float>(get_perf_counter_freq());
 }
-}
-
-struct Gfx {
-    std::unique_ptr<glwx::SpriteRenderer> renderer;
-    glm::mat4 projection;
-    std::array<glw::Texture, 64> textures;
-
-    static Gfx& instance()
-    {
-        static Gfx gfx;
-        return gfx;
-    }
-};
-
-namespace gfx {
-void init()
-{
-    auto& plat = Platform::instance();
-    auto& gfx = Gfx::instance();
-    glw::State::instance().setViewport(plat.window.getSize().x, plat.window.getSize().y);
-    gfx.renderer = std::make_unique<glwx::SpriteRenderer>();
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    gfx.projection = glm::ortho(0.0f, static_cast<float>(plat.window.getSize().x),
-        static_cast<float>(plat.window.getSize().y), 0.0f);
-    glDepthFunc(GL_ALWAYS);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-}
-
-void render_begin()
-{
-    auto& gfx = Gfx::instance();
-    glClear(GL_COLOR_BUFFER_BIT);
-    gfx.renderer->getDefaultShaderProgram().bind();
-    gfx.renderer->getDefaultShaderProgram().setUniform("projectionMatrix", gfx.projection);
-
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplSDL2_NewFrame();
-    ImGui::NewFrame();
-}
 
-void render_end()
+uint32_t get_window_width()
 {
-    Gfx::instance().renderer->flush();
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-    Platform::instance().window.swap();
+    return static_cast<uint32_t>(Platform::instance().window.getSize().x);
 }
 
-Texture* load_texture(std::string_view path)
+uint32_t get_window_height()
 {
-    auto& gfx = Gfx::instance();
-    size_t tex_idx = 0;
-    while (tex_idx < gfx.textures.size()
-        && gfx.textures[tex_idx].getTarget() != glw::Texture::Target::Invalid) {
-        tex_idx++;
-    }
-    assert(tex_idx < gfx.textures.size());
-    auto tex = glwx::makeTexture2D(path, false);
-    if (!tex) {
-        return nullptr;
-    }
-    gfx.textures[tex_idx] = std::move(tex.value());
-    return (Texture*)&gfx.textures[tex_idx];
+    return static_cast<uint32_t>(Platform::instance().window.getSize().y);
 }
 
-void draw(const Texture* texture, float x, float y, float scale, float r, float g, float b, float a)
+void swap_window()
 {
-    auto tex = (const glw::Texture*)texture;
-    assert(tex->getTarget() != glw::Texture::Target::Invalid);
-    auto& renderer = Gfx::instance().renderer;
-    const auto trafo = glwx::Transform2D(glm::vec2(x, y), 0.0f, glm::vec2(scale),
-        glm::vec2(tex->getWidth(), tex->getHeight()) * -0.5f);
-    renderer->color = glm::vec4(r, g, b, a);
-    renderer->draw(*tex, trafo);
+    Platform::instance().window.swap();
 }
 }
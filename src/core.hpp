@@ -21,8 +21,11 @@ struct InputState {
 
     bool is_down(const char* key);
     bool is_pressed(const char* key);
+    bool is_down(int scancode);
+    bool is_pressed(int scancode);
 };
 
+// Returns 0 for unknown names
 int get_scancode(const char* name);
 
 // returns whether the window is still open
@@ -33,19 +36,11 @@ float get_time();
 uint64_t get_perf_counter();
 uint64_t get_perf_counter_freq();
 float get_perf_counter_elapsed(uint64_t start, uint64_t factor);
-}
-
-namespace gfx {
-void init();
-void render_begin();
-void render_end();
-
-struct Texture;
-
-Texture* load_texture(std::string_view path);
-void draw(
-    const Texture* texture, float x, float y, float scale, float r, float g, float b, float a);
 
+// Size of the window's drawable area in pixels
+uint32_t get_window_width();
+uint32_t get_window_height();
+void swap_window();
 }
 
 template <typename T>
@@ -0,0 +1,131 @@
+#include "drawlists.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+
+constexpr size_t ChunkSize = 256;
+
+struct Chunk {
+    std::array<std::byte, ChunkSize> data;
+    uint32_t refcount = 0; // 0 means the chunk is free
+};
+
+struct DrawList {
+    bool stored = false;
+    uint64_t stamp = 0;
+    size_t size = 0;
+    uint64_t textures = 0;
+    std::vector<uint32_t> chunks;
+};
+
+struct DrawLists {
+    std::vector<Chunk> chunks;
+    std::vector<uint32_t> free_chunks;
+    std::vector<DrawList> frames;
+    uint64_t next_stamp = 1;
+
+    static DrawLists& instance()
+    {
+        static DrawLists lists;
+        return lists;
+    }
+};
+
+static void release_chunks(DrawLists& lists, DrawList& list)
+{
+    for (const auto id : list.chunks) {
+        assert(lists.chunks[id].refcount > 0);
+        if (--lists.chunks[id].refcount == 0) {
+            lists.free_chunks.push_back(id);
+        }
+    }
+    list.chunks.clear();
+}
+
+static uint32_t add_chunk(DrawLists& lists, const std::byte* data, size_t size)
+{
+    uint32_t id = 0;
+    if (!lists.free_chunks.empty()) {
+        id = lists.free_chunks.back();
+        lists.free_chunks.pop_back();
+    } else {
+        id = static_cast<uint32_t>(lists.chunks.size());
+        lists.chunks.emplace_back();
+    }
+    auto& chunk = lists.chunks[id];
+    chunk.data = {};
+    std::memcpy(chunk.data.data(), data, size);
+    chunk.refcount = 1;
+    return id;
+}
+
+namespace drawlists {
+void store(uint32_t frame_id, std::span<const std::byte> commands, uint64_t textures)
+{
+    auto& lists = DrawLists::instance();
+    if (frame_id >= lists.frames.size()) {
+        lists.frames.resize(frame_id + 1);
+    }
+
+    // Build the new list before releasing the old one, in case it's also the previous frame's
+    DrawList list { true, lists.next_stamp++, commands.size(), textures, {} };
+    const DrawList* prev = frame_id > 0 ? &lists.frames[frame_id - 1] : nullptr;
+    for (size_t offset = 0; offset < commands.size(); offset += ChunkSize) {
+        const auto size = std::min(ChunkSize, commands.size() - offset);
+        const auto idx = offset / ChunkSize;
+        // The tail of the last chunk is always zero, so comparing the whole chunk is fine
+        if (prev && idx < prev->chunks.size()) {
+            const auto prev_id = prev->chunks[idx];
+            auto& prev_chunk = lists.chunks[prev_id];
+            std::array<std::byte, ChunkSize> data = {};
+            std::memcpy(data.data(), commands.data() + offset, size);
+            if (data == prev_chunk.data) {
+                prev_chunk.refcount++;
+                list.chunks.push_back(prev_id);
+                continue;
+            }
+        }
+        list.chunks.push_back(add_chunk(lists, commands.data() + offset, size));
+    }
+
+    release_chunks(lists, lists.frames[frame_id]);
+    lists.frames[frame_id] = std::move(list);
+}
+
+bool load(uint32_t frame_id, uint64_t textures, std::vector<std::byte>* commands)
+{
+    const auto& lists = DrawLists::instance();
+    if (frame_id >= lists.frames.size()) {
+        return false;
+    }
+    const auto& list = lists.frames[frame_id];
+    if (!list.stored || list.textures != textures) {
+        return false;
+    }
+    commands->resize(list.size);
+    for (size_t i = 0; i < list.chunks.size(); ++i) {
+        const auto offset = i * ChunkSize;
+        const auto size = std::min(ChunkSize, list.size - offset);
+        std::memcpy(commands->data() + offset, lists.chunks[list.chunks[i]].data.data(), size);
+    }
+    return true;
+}
+
+uint64_t get_stamp(uint32_t frame_id)
+{
+    const auto& lists = DrawLists::instance();
+    return frame_id < lists.frames.size() ? lists.frames[frame_id].stamp : 0;
+}
+
+size_t get_memory_usage()
+{
+    const auto& lists = DrawLists::instance();
+    size_t size = lists.chunks.size() * sizeof(Chunk);
+    for (const auto& list : lists.frames) {
+        size += sizeof(DrawList) + list.chunks.size() * sizeof(uint32_t);
+    }
+    return size;
+}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// The draw commands (see gfx::CommandBuffer) each frame rendered, indexed by snapshot id, so paused
+// frames can be drawn again without restoring them and calling into the game code.
+namespace drawlists {
+// Replaces what was stored for the frame. Parts that are the same as in the previous frame are
+// shared, so static scenes take almost no memory. textures is the gfx::get_texture_generation() at
+// the time the commands were recorded.
+void store(uint32_t frame_id, std::span<const std::byte> commands, uint64_t textures);
+// Returns false if nothing was stored for the frame or the textures changed since
+bool load(uint32_t frame_id, uint64_t textures, std::vector<std::byte>* commands);
+// Changes every time the frame's list is stored, 0 if nothing was stored for it
+uint64_t get_stamp(uint32_t frame_id);
+size_t get_memory_usage();
+}
@@ -1,45 +1,206 @@
 #include "engine.hpp"
 
 #include "fswatcher.hpp"
+#include "jobs.hpp"
+#include "kernels.hpp"
 #include "memtrack.hpp"
+#include "pool.hpp"
+#include "spatial.hpp"
+#include "text.hpp"
+#include "tilemap.hpp"
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/mman.h>
 
 #include <fmt/core.h>
 
 Vm* vm;
 
+// Scratch memory for game code. It is not tracked by memtrack, so it's not part of any snapshot.
+constexpr size_t FrameArenaSize = 16 * 1024 * 1024;
+constexpr size_t FrameArenaAlignment = 16;
+std::unique_ptr<std::byte[]> frame_arena;
+std::atomic<size_t> frame_arena_used = 0; // jobs allocate from it too
+
+// Errors in jobs are only reported if they happened at the lowest index that broke, so they are
+// kept per thread first.
+thread_local std::optional<Vm::Error> job_error;
+// This is not a local in the chunk loop, because it needs to be read after a longjmp
+thread_local size_t job_index = 0;
+
+using ParallelForFunc = void(void* ctx, size_t index, rng::RandomState* rng);
+
+struct ParallelFor {
+    ParallelForFunc* func = nullptr;
+    void* ctx = nullptr;
+    uint64_t seed = 0;
+    std::atomic<size_t> break_index = SIZE_MAX; // also makes the job pool skip all later chunks
+    std::mutex mutex;
+    gamecode::BreakInfo break_info = {};
+    std::optional<Vm::Error> error;
+};
+
+struct JobChunk {
+    ParallelFor* pf;
+    size_t begin;
+    size_t end;
+};
+
+// The geometry of tilemap chunks is built outside of tracked memory and reused as long as the
+// chunk's stamp stays the same. Stamps are hashes of the tiles, so after a restore a chunk is only
+// rebuilt if its tiles actually differ.
+struct TilemapChunk {
+    std::optional<uint64_t> stamp;
+    std::vector<gfx::Quad> quads;
+};
+
+struct TilemapCache {
+    gfx::TextureInfo tileset = {};
+    uint32_t tile_size = 0;
+    std::vector<TilemapChunk> chunks;
+    bool drawn = false; // since the last prune_tilemap_caches
+};
+
+std::unordered_map<const tilemap::Tilemap*, TilemapCache> tilemap_caches;
+
+// The path each image handle was loaded from, so loading it again returns the same handle
+std::array<std::string, std::tuple_size_v<decltype(HotReloadState::textures)>> image_paths;
+
 void set_ng_vm(Vm* p)
 {
     vm = p;
+    frame_arena = std::make_unique<std::byte[]>(FrameArenaSize);
 }
 
-static void reload_image(void* ctx, std::string_view path)
+void prune_tilemap_caches()
+{
+    for (auto it = tilemap_caches.begin(); it != tilemap_caches.end();) {
+        if (it->second.drawn) {
+            it->second.drawn = false;
+            ++it;
+        } else {
+            it = tilemap_caches.erase(it);
+        }
+    }
+}
+
+void reset_frame_arena()
+{
+    frame_arena_used.store(0);
+}
+
+// Most engine functions work on engine state without any synchronization (and their results would
+// depend on the order the jobs run in), so they may not be called from jobs.
+static void check_not_in_job(const char* function)
+{
+    if (jobs::in_job()) {
+        // No std::string, because ng_error does not return
+        std::array<char, 128> msg;
+        const auto res = fmt::format_to_n(
+            msg.data(), msg.size() - 1, "{} can not be called from ng_parallel_for", function);
+        *res.out = '\0';
+        ng_error_internal(__FILE__, __LINE__, msg.data());
+    }
+}
+
+static void image_loaded(void* ctx, gfx::Texture* tex)
 {
     const auto idx = (uintptr_t)ctx;
-    const auto tex = gfx::load_texture(path);
+    auto& current = vm->hot_most_recent.textures[idx];
     if (!tex) {
-        fmt::println("Could not reload {}", path);
-        return;
+        fmt::println("Could not load image {}", idx + 1);
+        return; // keep the previous version (or the placeholder)
     }
-    vm->hot_most_recent.textures[idx] = tex;
+    // The handle owns a reference. If the contents did not change, tex is the same texture.
+    gfx::release_texture(current);
+    current = tex;
+    // Snapshots might still reference the old texture, but Vm::restore replaces them
+    vm->engine_state.textures[idx] = tex;
+}
+
+static void reload_image(void* ctx, std::string_view path)
+{
+    gfx::load_texture_async(path, image_loaded, ctx);
 }
 
 extern "C" void* ng_alloc(size_t size)
 {
+    return ng_alloc_ex(size, NgAllocVolatile);
+}
+
+extern "C" void* ng_alloc_ex(size_t size, uint32_t flags)
+{
+    check_not_in_job("ng_alloc");
+    if (flags == NgAllocImmutable) {
+        if (size == 0) {
+            ng_error_internal(__FILE__, __LINE__, "NG_IMMUTABLE allocations must not be empty");
+            return nullptr;
+        }
+        // Gets its own pages, so they can be write-protected. mmap zeroes them.
+        auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            ng_error_internal(__FILE__, __LINE__, "Could not allocate NG_IMMUTABLE memory");
+            return nullptr;
+        }
+        memtrack::track(ptr, size, memtrack::Policy::Immutable);
+        return ptr;
+    }
     auto ptr = malloc(size);
+    if (!ptr) {
+        ng_error_internal(__FILE__, __LINE__, "Out of memory");
+        return nullptr;
+    }
     memset(ptr, 0, size);
-    memtrack::track(ptr, size);
+    memtrack::track(ptr, size,
+        flags == NgAllocTransient ? memtrack::Policy::Transient : memtrack::Policy::Volatile);
     return ptr;
 }
 
+extern "C" void* ng_frame_alloc(size_t size)
+{
+    const auto aligned = (size + FrameArenaAlignment - 1) & ~(FrameArenaAlignment - 1);
+    const auto offset = frame_arena_used.fetch_add(aligned);
+    if (offset > FrameArenaSize || aligned > FrameArenaSize - offset) {
+        ng_error_internal(__FILE__, __LINE__, "Frame arena exhausted");
+        return nullptr;
+    }
+    return frame_arena.get() + offset;
+}
+
 extern "C" uint32_t ng_load_image(const char* path)
 {
+    check_not_in_job("ng_load_image");
+    auto& textures = vm->engine_state.textures;
+    for (uint32_t i = 0; i < textures.size(); ++i) {
+        if (textures[i] && image_paths[i] == path) {
+            return i + 1; // already loaded (and watched)
+        }
+    }
     uint32_t idx = 0;
-    while (idx < vm->engine_state.textures.size() && vm->engine_state.textures[idx] != nullptr) {
+    while (idx < textures.size() && textures[idx] != nullptr) {
         idx++;
     }
-    assert(idx < vm->engine_state.textures.size());
-    vm->engine_state.textures[idx] = gfx::load_texture(path);
-    assert(vm->engine_state.textures[idx]);
+    if (idx == textures.size()) {
+        ng_error_internal(__FILE__, __LINE__, "Too many images");
+        return 0;
+    }
+    image_paths[idx] = path;
+    // The image shows up once it's decoded, so loading does not stall the frame
+    const auto tex = gfx::get_placeholder_texture();
+    textures[idx] = tex;
+    vm->hot_most_recent.textures[idx] = tex;
+    gfx::load_texture_async(path, image_loaded, (void*)static_cast<uintptr_t>(idx));
     fsw::add_watch(path, reload_image, (void*)static_cast<uintptr_t>(idx));
     return idx + 1; // 0 is invalid
 }
@@ -47,11 +208,84 @@ extern "C" uint32_t ng_load_image(const char* path)
 extern "C" void ng_draw_sprite(
     uint32_t image_handle, float x, float y, float scale, float r, float g, float b, float a)
 {
+    check_not_in_job("ng_draw_sprite");
     assert(image_handle != 0 && image_handle <= vm->engine_state.textures.size());
     const auto texture = vm->engine_state.textures[image_handle - 1];
     gfx::draw(texture, x, y, scale, r, g, b, a);
 }
 
+extern "C" void ng_draw_sprites(
+    uint32_t image_handle, const gfx::SpriteInstance* instances, size_t count)
+{
+    check_not_in_job("ng_draw_sprites");
+    assert(image_handle != 0 && image_handle <= vm->engine_state.textures.size());
+    gfx::draw(vm->engine_state.textures[image_handle - 1], instances, count);
+}
+
+extern "C" void ng_draw_sprites_mixed(const MixedSpriteInstance* instances, size_t count)
+{
+    check_not_in_job("ng_draw_sprites_mixed");
+    // Draw runs of instances with the same image, so the texture lookup is only done once per run
+    size_t i = 0;
+    while (i < count) {
+        const auto image_handle = instances[i].image_handle;
+        assert(image_handle != 0 && image_handle <= vm->engine_state.textures.size());
+        const auto run_start = i;
+        while (i < count && instances[i].image_handle == image_handle) {
+            i++;
+        }
+        gfx::draw(vm->engine_state.textures[image_handle - 1], &instances[run_start].sprite,
+            i - run_start, sizeof(MixedSpriteInstance));
+    }
+}
+
+extern "C" void ng_set_layer(uint32_t layer)
+{
+    check_not_in_job("ng_set_layer");
+    assert(layer <= 0xffff);
+    gfx::set_layer(static_cast<uint16_t>(layer));
+}
+
+extern "C" uint32_t ng_load_font(const char* path, float size)
+{
+    check_not_in_job("ng_load_font");
+    if (!(size > 0.0f && size <= text::MaxFontSize)) {
+        ng_error_internal(__FILE__, __LINE__, "Font size out of range");
+        return 0;
+    }
+    if (text::get_num_fonts() == text::MaxNumFonts) {
+        ng_error_internal(__FILE__, __LINE__, "Too many fonts");
+        return 0;
+    }
+    const auto font = text::load_font(path, size);
+    if (!font) {
+        ng_error_internal(__FILE__, __LINE__, "Could not load font");
+        return 0;
+    }
+    return *font;
+}
+
+extern "C" void ng_draw_text(
+    uint32_t font, const char* str, float x, float y, float r, float g, float b, float a)
+{
+    check_not_in_job("ng_draw_text");
+    if (font == 0 || font > text::get_num_fonts()) {
+        ng_error_internal(__FILE__, __LINE__, "Invalid font handle");
+        return;
+    }
+    text::draw(font, str, x, y, r, g, b, a);
+}
+
+extern "C" float ng_measure_text(uint32_t font, const char* str)
+{
+    check_not_in_job("ng_measure_text");
+    if (font == 0 || font > text::get_num_fonts()) {
+        ng_error_internal(__FILE__, __LINE__, "Invalid font handle");
+        return 0.0f;
+    }
+    return text::measure(font, str);
+}
+
 extern "C" bool ng_is_key_down(const char* key)
 {
     return vm->engine_state.input_state.is_down(key);
@@ -62,11 +296,342 @@ extern "C" int ng_key_pressed(const char* key)
     return vm->engine_state.input_state.is_pressed(key);
 }
 
+extern "C" int ng_key(const char* name)
+{
+    return platform::get_scancode(name);
+}
+
+// Key handles come from game code, so they are checked before indexing the key arrays
+static bool check_key(int key)
+{
+    if (key < 0 || static_cast<size_t>(key) >= MaxNumScancodes) {
+        ng_error_internal(__FILE__, __LINE__, "Invalid key handle");
+        return false;
+    }
+    return true;
+}
+
+extern "C" bool ng_is_key_down_id(int key)
+{
+    return check_key(key) && vm->engine_state.input_state.is_down(key);
+}
+
+extern "C" int ng_key_pressed_id(int key)
+{
+    return check_key(key) ? vm->engine_state.input_state.is_pressed(key) : 0;
+}
+
 extern "C" float ng_randomf()
 {
+    check_not_in_job("ng_randomf");
     return rng::randomf(&vm->engine_state.random_state);
 }
 
+extern "C" pool::Pool* ng_pool_create(
+    uint32_t capacity, const uint32_t* component_sizes, uint32_t num_components)
+{
+    check_not_in_job("ng_pool_create");
+    if (num_components == 0 || num_components > pool::MaxComponents) {
+        ng_error_internal(__FILE__, __LINE__, "Invalid number of pool components");
+        return nullptr;
+    }
+    for (uint32_t c = 0; c < num_components; ++c) {
+        if (component_sizes[c] == 0) {
+            ng_error_internal(__FILE__, __LINE__, "Pool component size must not be 0");
+            return nullptr;
+        }
+    }
+    // The size is a multiple of the alignment already
+    const auto size = pool::get_size(capacity, component_sizes, num_components);
+    // The component offsets are 32 bit
+    if (size > UINT32_MAX) {
+        ng_error_internal(__FILE__, __LINE__, "Pool is too large");
+        return nullptr;
+    }
+    auto ptr = std::aligned_alloc(pool::Alignment, size);
+    if (!ptr) {
+        ng_error_internal(__FILE__, __LINE__, "Out of memory");
+        return nullptr;
+    }
+    memset(ptr, 0, size);
+    memtrack::track(ptr, size);
+    return pool::init(ptr, capacity, component_sizes, num_components);
+}
+
+extern "C" uint32_t ng_pool_add(pool::Pool* p)
+{
+    check_not_in_job("ng_pool_add");
+    if (p->count == p->capacity) {
+        ng_error_internal(__FILE__, __LINE__, "Pool is full");
+        return 0;
+    }
+    return pool::add(p);
+}
+
+extern "C" uint32_t ng_pool_remove(pool::Pool* p, uint32_t index)
+{
+    check_not_in_job("ng_pool_remove");
+    if (index >= p->count) {
+        ng_error_internal(__FILE__, __LINE__, "Pool index out of range");
+        return 0;
+    }
+    return pool::remove(p, index);
+}
+
+extern "C" uint32_t ng_pool_count(const pool::Pool* p)
+{
+    return p->count;
+}
+
+extern "C" void* ng_pool_component(pool::Pool* p, uint32_t component)
+{
+    if (component >= p->num_components) {
+        ng_error_internal(__FILE__, __LINE__, "Pool component out of range");
+        return nullptr;
+    }
+    return pool::get_component(p, component);
+}
+
+extern "C" tilemap::Tilemap* ng_tilemap_create(
+    uint32_t image_handle, uint32_t tile_size, uint32_t width, uint32_t height)
+{
+    check_not_in_job("ng_tilemap_create");
+    // Handles of images that were never loaded are in range, but have no texture
+    if (image_handle == 0 || image_handle > vm->engine_state.textures.size()
+        || !vm->engine_state.textures[image_handle - 1]) {
+        ng_error_internal(__FILE__, __LINE__, "Invalid tilemap image");
+        return nullptr;
+    }
+    if (tile_size == 0 || width == 0 || height == 0) {
+        ng_error_internal(__FILE__, __LINE__, "Tilemap size must not be 0");
+        return nullptr;
+    }
+    const auto size = tilemap::get_size(width, height);
+    auto ptr = std::aligned_alloc(tilemap::Alignment, size);
+    if (!ptr) {
+        ng_error_internal(__FILE__, __LINE__, "Out of memory");
+        return nullptr;
+    }
+    memset(ptr, 0, size);
+    memtrack::track(ptr, size);
+    return tilemap::init(ptr, image_handle, tile_size, width, height);
+}
+
+extern "C" void ng_tilemap_set(tilemap::Tilemap* map, uint32_t x, uint32_t y, uint32_t tile)
+{
+    check_not_in_job("ng_tilemap_set");
+    if (!map) {
+        ng_error_internal(__FILE__, __LINE__, "Tilemap is null");
+        return;
+    }
+    if (x >= map->width || y >= map->height) {
+        ng_error_internal(__FILE__, __LINE__, "Tile position out of range");
+        return;
+    }
+    tilemap::set(map, x, y, tile);
+}
+
+extern "C" uint32_t ng_tilemap_get(const tilemap::Tilemap* map, uint32_t x, uint32_t y)
+{
+    if (!map) {
+        ng_error_internal(__FILE__, __LINE__, "Tilemap is null");
+        return 0;
+    }
+    if (x >= map->width || y >= map->height) {
+        ng_error_internal(__FILE__, __LINE__, "Tile position out of range");
+        return 0;
+    }
+    return tilemap::get(map, x, y);
+}
+
+extern "C" void ng_tilemap_draw(const tilemap::Tilemap* map, float x, float y)
+{
+    check_not_in_job("ng_tilemap_draw");
+    if (!map) {
+        ng_error_internal(__FILE__, __LINE__, "Tilemap is null");
+        return;
+    }
+    // The map is in game memory, so the handle is checked like in ng_tilemap_create
+    const auto handle = map->image_handle;
+    if (handle == 0 || handle > vm->engine_state.textures.size()
+        || !vm->engine_state.textures[handle - 1]) {
+        ng_error_internal(__FILE__, __LINE__, "Invalid tilemap image");
+        return;
+    }
+    const auto tileset = gfx::get_texture_info(vm->engine_state.textures[handle - 1]);
+    auto& cache = tilemap_caches[map];
+    cache.drawn = true;
+    const auto num_chunks = tilemap::get_num_chunks(map);
+    if (cache.chunks.size() != num_chunks || cache.tileset != tileset
+        || cache.tile_size != map->tile_size) {
+        // The image was (re)loaded (so all texture coordinates changed) or this is another map
+        cache.tileset = tileset;
+        cache.tile_size = map->tile_size;
+        cache.chunks.resize(num_chunks);
+        for (auto& chunk : cache.chunks) {
+            chunk.stamp.reset();
+        }
+    }
+    for (uint32_t i = 0; i < num_chunks; ++i) {
+        const auto bounds = tilemap::get_chunk_bounds(map, i);
+        if (!gfx::is_visible(bounds.x0 + x, bounds.y0 + y, bounds.x1 + x, bounds.y1 + y)) {
+            continue;
+        }
+        // Chunks are only built once they are visible
+        auto& chunk = cache.chunks[i];
+        const auto stamp = tilemap::get_stamp(map, i);
+        if (chunk.stamp != stamp) {
+            tilemap::build_chunk(map, i, tileset, &chunk.quads);
+            chunk.stamp = stamp;
+        }
+        gfx::draw_quads(tileset.page, chunk.quads, x, y);
+    }
+}
+
+extern "C" void ng_spatial_clear(float cell_size)
+{
+    check_not_in_job("ng_spatial_clear");
+    if (!(cell_size > 0.0f) || !std::isfinite(cell_size)) {
+        ng_error_internal(__FILE__, __LINE__, "Spatial cell size must be positive and finite");
+        return;
+    }
+    spatial::clear(cell_size);
+}
+
+extern "C" void ng_spatial_insert(uint32_t id, float x, float y)
+{
+    check_not_in_job("ng_spatial_insert");
+    spatial::insert(id, x, y);
+}
+
+extern "C" size_t ng_spatial_query_radius(
+    float x, float y, float radius, uint32_t* out_ids, size_t capacity)
+{
+    if (!(radius >= 0.0f)) { // also NaN
+        ng_error_internal(__FILE__, __LINE__, "Query radius must not be negative");
+        return 0;
+    }
+    return spatial::query_radius(x, y, radius, out_ids, capacity);
+}
+
+extern "C" void ng_bulk_integrate(
+    float* x, float* y, const float* vx, const float* vy, size_t count, float dt)
+{
+    kernels::integrate(x, y, vx, vy, count, dt);
+}
+
+extern "C" void ng_bulk_distance(
+    const float* x, const float* y, size_t count, float px, float py, float* out)
+{
+    kernels::distance_to_point(x, y, count, px, py, out);
+}
+
+extern "C" void ng_bulk_clamp(float* values, size_t count, float min, float max)
+{
+    kernels::clamp(values, count, min, max);
+}
+
+extern "C" void ng_bulk_lerp(const float* a, const float* b, size_t count, float t, float* out)
+{
+    kernels::lerp(a, b, count, t, out);
+}
+
+extern "C" size_t ng_bulk_circle_contains(
+    float cx, float cy, float radius, const float* x, const float* y, size_t count, uint8_t* out)
+{
+    return kernels::circle_contains(cx, cy, radius, x, y, count, out);
+}
+
+extern "C" float ng_randomf_r(rng::RandomState* rng)
+{
+    return rng::randomf(rng);
+}
+
+extern "C" rng::Stream ng_random_stream(uint64_t id)
+{
+    return rng::make_stream(vm->engine_state.random_seed, id);
+}
+
+extern "C" float ng_randomf_stream(rng::Stream* stream)
+{
+    return rng::randomf(stream);
+}
+
+extern "C" void ng_random_fill(rng::Stream* stream, float* out, size_t count)
+{
+    rng::fill(stream, out, count);
+}
+
+static void run_job_chunk(void* ctx)
+{
+    const auto& chunk = *static_cast<JobChunk*>(ctx);
+    for (job_index = chunk.begin; job_index < chunk.end; ++job_index) {
+        if (job_index >= chunk.pf->break_index.load()) {
+            return;
+        }
+        // Every index gets its own stream, so the results don't depend on which thread runs it
+        rng::RandomState key { chunk.pf->seed + job_index };
+        rng::RandomState rng { rng::random(&key) };
+        chunk.pf->func(chunk.pf->ctx, job_index, &rng);
+    }
+}
+
+static void run_parallel_for_chunk(void* ctx, size_t begin, size_t end)
+{
+    auto& pf = *static_cast<ParallelFor*>(ctx);
+    JobChunk chunk { &pf, begin, end };
+    if (!gamecode::call(run_job_chunk, &chunk)) {
+        return;
+    }
+    // Only the break at the lowest index counts, so that it's the same as if the indices were
+    // processed in order.
+    std::lock_guard lock(pf.mutex);
+    if (job_index < pf.break_index.load()) {
+        pf.break_index.store(job_index);
+        pf.break_info = gamecode::get_break_info();
+        pf.error = std::move(job_error);
+    }
+    job_error.reset();
+}
+
+extern "C" void ng_parallel_for(size_t count, size_t grain, ParallelForFunc* func, void* ctx)
+{
+    check_not_in_job("ng_parallel_for");
+    if (grain == 0) {
+        ng_error_internal(__FILE__, __LINE__, "ng_parallel_for grain must not be 0");
+        return;
+    }
+    // Chunk indices are 32 bit
+    if (count / grain + (count % grain != 0) > UINT32_MAX) {
+        ng_error_internal(__FILE__, __LINE__, "ng_parallel_for count is too large for the grain");
+        return;
+    }
+    // Queries only read the grid once it's built
+    spatial::build();
+
+    gamecode::BreakInfo break_info;
+    bool broken = false;
+    {
+        // The seed is drawn here, so replays get the same streams
+        ParallelFor pf;
+        pf.func = func;
+        pf.ctx = ctx;
+        pf.seed = rng::random(&vm->engine_state.random_state);
+        jobs::parallel_for(count, grain, run_parallel_for_chunk, &pf, &pf.break_index);
+        broken = pf.break_index.load() != SIZE_MAX;
+        if (broken) {
+            break_info = pf.break_info;
+            if (pf.error) {
+                vm->error = std::move(pf.error);
+            }
+        }
+    }
+    // Everything above needs to be destroyed before jumping out
+    if (broken) {
+        gamecode::forward_break(break_info);
+    }
+}
+
 extern "C" void ng_break_internal(const char* file, int line)
 {
     fmt::println("break from {}:{}", file, line);
@@ -75,6 +640,7 @@ extern "C" void ng_break_internal(const char* file, int line)
 
 extern "C" uint64_t ng_timestamp_internal(const char* file, int line)
 {
+    check_not_in_job("ng_timestamp");
     const auto ts = vm->next_timestamp();
     if (vm->stop_timestamp == ts) {
         ng_break_internal(file, line);
@@ -84,6 +650,6 @@ extern "C" uint64_t ng_timestamp_internal(const char* file, int line)
 
 extern "C" void ng_error_internal(const char* file, int line, const char* message)
 {
-    vm->error = Vm::Error { file, line, message };
+    (jobs::in_job() ? job_error : vm->error) = Vm::Error { file, line, message };
     ng_break_internal(file, line);
 }
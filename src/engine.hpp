@@ -1,19 +1,83 @@
 #pragma once
 
+#include "pool.hpp"
+#include "tilemap.hpp"
 #include "vm.hpp"
 
+// The layout must match MixedSpriteInstance in game/engine.h
+struct MixedSpriteInstance {
+    uint32_t image_handle;
+    gfx::SpriteInstance sprite;
+};
+
+// Must match the NG_* allocation flags in game/engine.h
+enum NgAllocFlags : uint32_t {
+    NgAllocVolatile = 0,
+    NgAllocImmutable = 1,
+    NgAllocTransient = 2,
+};
+
 // Store a pointer to the VM instance to be referenced by the ng functions below
 void set_ng_vm(Vm* vm);
 
+// Drops the cached geometry of tilemaps that were not drawn since the last call, e.g. ones that
+// only existed in a timeline that was abandoned by restoring a snapshot
+void prune_tilemap_caches();
+
+// Frees everything allocated with ng_frame_alloc. Called before every update/render call.
+void reset_frame_arena();
+
 // These functions will be called by the game, the state they implicitly reference is encapsulated
 // by EngineState above and can be pointed to by set_engine_state;
 extern "C" void* ng_alloc(size_t size);
+extern "C" void* ng_alloc_ex(size_t size, uint32_t flags);
+extern "C" void* ng_frame_alloc(size_t size);
 extern "C" uint32_t ng_load_image(const char* path);
 extern "C" void ng_draw_sprite(
     uint32_t image_handle, float x, float y, float scale, float r, float g, float b, float a);
+extern "C" void ng_draw_sprites(
+    uint32_t image_handle, const gfx::SpriteInstance* instances, size_t count);
+extern "C" void ng_draw_sprites_mixed(const MixedSpriteInstance* instances, size_t count);
+extern "C" void ng_set_layer(uint32_t layer);
+extern "C" uint32_t ng_load_font(const char* path, float size);
+extern "C" void ng_draw_text(
+    uint32_t font, const char* str, float x, float y, float r, float g, float b, float a);
+extern "C" float ng_measure_text(uint32_t font, const char* str);
 extern "C" bool ng_is_key_down(const char* key);
 extern "C" int ng_key_pressed(const char* key);
+extern "C" int ng_key(const char* name);
+extern "C" bool ng_is_key_down_id(int key);
+extern "C" int ng_key_pressed_id(int key);
 extern "C" float ng_randomf();
+extern "C" pool::Pool* ng_pool_create(
+    uint32_t capacity, const uint32_t* component_sizes, uint32_t num_components);
+extern "C" uint32_t ng_pool_add(pool::Pool* p);
+extern "C" uint32_t ng_pool_remove(pool::Pool* p, uint32_t index);
+extern "C" uint32_t ng_pool_count(const pool::Pool* p);
+extern "C" void* ng_pool_component(pool::Pool* p, uint32_t component);
+extern "C" tilemap::Tilemap* ng_tilemap_create(
+    uint32_t image_handle, uint32_t tile_size, uint32_t width, uint32_t height);
+extern "C" void ng_tilemap_set(tilemap::Tilemap* map, uint32_t x, uint32_t y, uint32_t tile);
+extern "C" uint32_t ng_tilemap_get(const tilemap::Tilemap* map, uint32_t x, uint32_t y);
+extern "C" void ng_tilemap_draw(const tilemap::Tilemap* map, float x, float y);
+extern "C" void ng_spatial_clear(float cell_size);
+extern "C" void ng_spatial_insert(uint32_t id, float x, float y);
+extern "C" size_t ng_spatial_query_radius(
+    float x, float y, float radius, uint32_t* out_ids, size_t capacity);
+extern "C" void ng_bulk_integrate(
+    float* x, float* y, const float* vx, const float* vy, size_t count, float dt);
+extern "C" void ng_bulk_distance(
+    const float* x, const float* y, size_t count, float px, float py, float* out);
+extern "C" void ng_bulk_clamp(float* values, size_t count, float min, float max);
+extern "C" void ng_bulk_lerp(const float* a, const float* b, size_t count, float t, float* out);
+extern "C" size_t ng_bulk_circle_contains(
+    float cx, float cy, float radius, const float* x, const float* y, size_t count, uint8_t* out);
+extern "C" float ng_randomf_r(rng::RandomState* rng);
+extern "C" rng::Stream ng_random_stream(uint64_t id);
+extern "C" float ng_randomf_stream(rng::Stream* stream);
+extern "C" void ng_random_fill(rng::Stream* stream, float* out, size_t count);
+extern "C" void ng_parallel_for(size_t count, size_t grain,
+    void (*func)(void* ctx, size_t index, rng::RandomState* rng), void* ctx);
 extern "C" void ng_break_internal(const char* file, int line);
 extern "C" uint64_t ng_timestamp_internal(const char* file, int line);
 extern "C" void ng_error_internal(const char* file, int line, const char* message);
@@ -1,8 +1,10 @@
 #include "fswatcher.hpp"
 
+#include <algorithm>
 #include <array>
-#include <cassert>
 #include <filesystem>
+#include <string>
+#include <vector>
 
 #include <fmt/core.h>
 
@@ -10,21 +12,47 @@ namespace fs = std::filesystem;
 
 namespace fsw {
 struct Watch {
-    std::string_view path;
+    std::string path;
     fs::file_time_type last_mod;
     ModifiedCallback* callback;
     void* ctx;
 };
 
-std::array<Watch, 128> watches = {};
+constexpr size_t MaxNumWatches = 128;
+std::array<Watch, MaxNumWatches> watches = {};
 
 void add_watch(std::string_view path, ModifiedCallback* callback, void* ctx)
 {
     for (auto& watch : watches) {
         if (watch.path.empty()) {
-            watch = Watch { path, fs::last_write_time(path), callback, ctx };
-            break;
+            watch = Watch { std::string(path), fs::last_write_time(path), callback, ctx };
+            return;
+        }
+        if (watch.path == path && watch.callback == callback && watch.ctx == ctx) {
+            return;
+        }
+    }
+    fmt::println("Too many watches, not watching {}", path);
+}
+
+void remove_watches(ModifiedCallback* callback, void* ctx, std::span<const std::string> keep)
+{
+    // The used watches stay at the front, because update stops at the first free one
+    size_t used = 0;
+    size_t num_kept = 0;
+    for (; used < MaxNumWatches && !watches[used].path.empty(); ++used) {
+        const auto& path = watches[used].path;
+        if (watches[used].callback == callback && watches[used].ctx == ctx
+            && std::find(keep.begin(), keep.end(), path) == keep.end()) {
+            continue;
+        }
+        if (num_kept != used) {
+            watches[num_kept] = std::move(watches[used]);
         }
+        num_kept++;
+    }
+    for (size_t i = num_kept; i < used; ++i) {
+        watches[i] = Watch {};
     }
 }
 
@@ -32,7 +60,9 @@ void add_watch(std::string_view path, ModifiedCallback* callback, void* ctx)
 
 bool update()
 {
-    bool reloaded = false;
+    // Saving a header and the file that includes it (or just saving multiple files at once) should
+    // only recompile once, so every callback/ctx pair is only called once.
+    std::vector<Watch> fired;
     for (auto& watch : watches) {
         if (watch.path.empty()) {
             break;
@@ -43,10 +73,21 @@ bool update()
         if (mod != watch.last_mod) {
             fmt::println("modified: {}", watch.path);
             watch.last_mod = mod;
-            watch.callback(watch.ctx, watch.path);
-            reloaded = true;
+            bool already_fired = false;
+            for (const auto& f : fired) {
+                if (f.callback == watch.callback && f.ctx == watch.ctx) {
+                    already_fired = true;
+                }
+            }
+            if (!already_fired) {
+                fired.push_back(watch);
+            }
         }
     }
-    return reloaded;
+    // Callbacks might add and remove watches, so we call them after iterating (with copies)
+    for (const auto& f : fired) {
+        f.callback(f.ctx, f.path);
+    }
+    return !fired.empty();
 }
 }
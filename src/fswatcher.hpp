@@ -1,11 +1,18 @@
 #pragma once
 
+#include <span>
+#include <string>
 #include <string_view>
 
 namespace fsw {
 using ModifiedCallback = void(void* ctx, std::string_view path);
 
-// path must point to a file
+// path must point to a file. Adding the same path with the same callback and ctx twice is a no-op.
+// If there are too many watches, an error is printed and the path is not watched.
 void add_watch(std::string_view path, ModifiedCallback* callback, void* ctx = nullptr);
+// Removes the watches with this callback and ctx whose path is not in `keep`
+void remove_watches(ModifiedCallback* callback, void* ctx, std::span<const std::string> keep);
+// If multiple watches with the same callback and ctx fire in a single update, the callback is only
+// called once (with the path of the first modified file).
 bool update();
 }
@@ -1,6 +1,18 @@
 #include "gamecode.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <csetjmp>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <ucontext.h>
 
 #include <fmt/core.h>
 #include <tcc.h>
@@ -11,19 +23,349 @@ using LoadFunc = void*();
 using UpdateFunc = void(void*, float t, float dt);
 using RenderFunc = void(const void*);
 
+// All functions compiled for a version (including static ones)
+struct CodeRange {
+    uintptr_t begin;
+    uintptr_t end;
+    std::string function;
+};
+
+struct LineEntry {
+    uintptr_t address; // first address of the line
+    int line;
+    uint32_t file; // index into GameCode::files
+};
+
 struct GameCode {
     TCCState* tcc = nullptr;
+    // Of all code and data, before relocating. Only used to tell whether a reload changed anything.
+    uint64_t hash = 0;
+    // The address range of the code that was compiled for this version
+    uintptr_t code_begin = 0;
+    uintptr_t code_end = 0;
+    std::vector<CodeRange> code; // sorted by address
+    std::vector<LineEntry> lines; // sorted by address
+    std::vector<std::string> files;
     LoadFunc* load = nullptr;
     UpdateFunc* update = nullptr;
     RenderFunc* render = nullptr;
 };
 
 std::array<GameCode, 256> game_codes;
-std::jmp_buf jump_buf;
-bool in_callback = false;
+// These are also accessed from signal handlers.
+// sigsetjmp/siglongjmp are used so the signal mask is restored when jumping out of a handler.
+// They are thread-local, because worker threads call game code too (see jobs.hpp) and a break
+// must only unwind the thread it happened on.
+thread_local sigjmp_buf jump_buf;
+thread_local volatile std::sig_atomic_t in_callback = false;
+thread_local volatile uintptr_t callback_stack_top = 0;
+thread_local volatile gamecode::BreakReason break_reason = gamecode::BreakReason::Break;
+thread_local volatile uintptr_t break_pc = 0;
+thread_local volatile int fault_signal = 0;
+thread_local volatile uintptr_t fault_address = 0;
+thread_local std::unique_ptr<std::byte[]> signal_stack;
+constexpr size_t SignalStackSize = 64 * 1024;
+uint32_t watchdog_budget_ms = 1000;
+// The watchdog timer only ever fires on the main thread (workers block it), so if it lands while
+// the main thread is waiting for them, it has to interrupt them explicitly.
+constexpr int InterruptSignal = SIGUSR1;
+std::array<pthread_t, 64> worker_threads;
+std::atomic<size_t> num_worker_threads = 0;
+
+constexpr uint64_t FnvOffsetBasis = 0xcbf29ce484222325ull;
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+    // FNV-1a
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+template <typename T>
+static uint64_t hash_value(uint64_t hash, const T& v)
+{
+    return hash_bytes(hash, &v, sizeof(T));
+}
+
+static uint64_t hash_str(uint64_t hash, const char* str)
+{
+    return hash_bytes(hash, str, std::strlen(str) + 1);
+}
+
+static Section* find_section(TCCState* tcc, const char* name)
+{
+    for (int i = 1; i < tcc->nb_sections; ++i) {
+        if (std::strcmp(tcc->sections[i]->name, name) == 0) {
+            return tcc->sections[i];
+        }
+    }
+    return nullptr;
+}
+
+struct FunctionInfo {
+    const char* name;
+    bool global;
+    ElfW(Addr) start;
+    ElfW(Addr) end;
+    uint64_t hash; // of the code and its relocations (but not what they refer to, see hash_data)
+};
+
+// This has to be called after compiling, but before relocating, so the code does not depend on
+// where it ends up in memory yet.
+// The returned functions are sorted by their address in the text section.
+static std::vector<FunctionInfo> hash_functions(TCCState* tcc)
+{
+    const auto symtab = find_section(tcc, ".symtab");
+    const auto text = find_section(tcc, ".text");
+    assert(symtab && text);
+    const auto strtab = reinterpret_cast<const char*>(symtab->link->data);
+    const auto syms = reinterpret_cast<const ElfW(Sym)*>(symtab->data);
+    const auto num_syms = symtab->data_offset / sizeof(ElfW(Sym));
+
+    std::vector<FunctionInfo> funcs;
+    for (size_t i = 0; i < num_syms; ++i) {
+        const auto& sym = syms[i];
+        if (ELFW(ST_TYPE)(sym.st_info) == STT_FUNC && sym.st_shndx == text->sh_num) {
+            funcs.push_back(FunctionInfo {
+                .name = strtab + sym.st_name,
+                .global = ELFW(ST_BIND)(sym.st_info) == STB_GLOBAL,
+                .start = sym.st_value,
+                .end = sym.st_value + sym.st_size,
+                .hash = hash_bytes(FnvOffsetBasis, text->data + sym.st_value, sym.st_size),
+            });
+        }
+    }
+    std::sort(funcs.begin(), funcs.end(),
+        [](const FunctionInfo& a, const FunctionInfo& b) { return a.start < b.start; });
+
+    const auto find_func = [&funcs](ElfW(Addr) offset) -> FunctionInfo* {
+        auto it = std::upper_bound(funcs.begin(), funcs.end(), offset,
+            [](ElfW(Addr) off, const FunctionInfo& func) { return off < func.start; });
+        if (it == funcs.begin() || offset >= std::prev(it)->end) {
+            return nullptr;
+        }
+        return &*std::prev(it);
+    };
+
+    const auto num_rels = text->reloc ? text->reloc->data_offset / sizeof(ElfW_Rel) : 0;
+    const auto rels = text->reloc ? reinterpret_cast<const ElfW_Rel*>(text->reloc->data) : nullptr;
+    for (size_t r = 0; r < num_rels; ++r) {
+        const auto& rel = rels[r];
+        const auto func = find_func(rel.r_offset);
+        if (!func) {
+            continue;
+        }
+
+        auto& hash = func->hash;
+        hash = hash_value(hash, rel.r_offset - func->start);
+        hash = hash_value(hash, ELFW(R_TYPE)(rel.r_info));
+        hash = hash_value(hash, rel.r_addend);
+
+        const auto& sym = syms[ELFW(R_SYM)(rel.r_info)];
+        hash = hash_str(hash, strtab + sym.st_name);
+    }
+    return funcs;
+}
+
+// Globals can reference functions and other data (e.g. a table of function pointers), which only
+// shows up in their relocations, so all data and its relocations are hashed as a whole.
+// Like hash_functions, this has to be called before relocating.
+static uint64_t hash_data(TCCState* tcc)
+{
+    const auto symtab = find_section(tcc, ".symtab");
+    const auto strtab = reinterpret_cast<const char*>(symtab->link->data);
+    const auto syms = reinterpret_cast<const ElfW(Sym)*>(symtab->data);
+    auto hash = FnvOffsetBasis;
+    for (int i = 1; i < tcc->nb_sections; ++i) {
+        const auto sec = tcc->sections[i];
+        if (!(sec->sh_flags & SHF_ALLOC) || (sec->sh_flags & SHF_EXECINSTR)) {
+            continue;
+        }
+        hash = hash_str(hash, sec->name);
+        if (sec->sh_type == SHT_NOBITS) {
+            hash = hash_value(hash, sec->data_offset);
+        } else {
+            hash = hash_bytes(hash, sec->data, sec->data_offset);
+        }
+        const auto num_rels = sec->reloc ? sec->reloc->data_offset / sizeof(ElfW_Rel) : 0;
+        for (size_t r = 0; r < num_rels; ++r) {
+            const auto& rel = reinterpret_cast<const ElfW_Rel*>(sec->reloc->data)[r];
+            const auto& sym = syms[ELFW(R_SYM)(rel.r_info)];
+            hash = hash_value(hash, rel.r_offset);
+            hash = hash_value(hash, ELFW(R_TYPE)(rel.r_info));
+            hash = hash_value(hash, rel.r_addend);
+            hash = hash_str(hash, strtab + sym.st_name);
+            hash = hash_value(hash, sym.st_value);
+        }
+    }
+    return hash;
+}
+
+// tcc emits stabs debug info by default. If it doesn't (e.g. when built with DWARF as the default),
+// we just have no line info.
+struct StabEntry {
+    uint32_t n_strx;
+    uint8_t n_type;
+    uint8_t n_other;
+    uint16_t n_desc;
+    uint32_t n_value;
+};
+
+constexpr uint8_t StabFunction = 0x24;
+constexpr uint8_t StabLine = 0x44;
+constexpr uint8_t StabSource = 0x64;
+constexpr uint8_t StabInclude = 0x84;
+
+// Like hash_functions, this has to be called before relocating. The addresses of the returned
+// line entries are offsets into the text section.
+static std::vector<LineEntry> read_lines(
+    TCCState* tcc, const std::vector<FunctionInfo>& funcs, std::vector<std::string>& files)
+{
+    std::vector<LineEntry> lines;
+    const auto stab = find_section(tcc, ".stab");
+    if (!stab || !stab->link) {
+        return lines;
+    }
+    const auto strtab = reinterpret_cast<const char*>(stab->link->data);
+    const auto entries = reinterpret_cast<const StabEntry*>(stab->data);
+    const auto num_entries = stab->data_offset / sizeof(StabEntry);
+
+    const FunctionInfo* func = nullptr;
+    uint32_t file = 0;
+    for (size_t i = 0; i < num_entries; ++i) {
+        const auto& entry = entries[i];
+        const std::string_view str = strtab + entry.n_strx;
+        if (entry.n_type == StabSource || entry.n_type == StabInclude) {
+            // N_SO is emitted for the directory too
+            if (!str.empty() && str.back() != '/') {
+                const auto it = std::find(files.begin(), files.end(), str);
+                file = static_cast<uint32_t>(it - files.begin());
+                if (it == files.end()) {
+                    files.emplace_back(str);
+                }
+            }
+        } else if (entry.n_type == StabFunction) {
+            // "name:F1" at the start of a function and an empty string at the end
+            const auto name = str.substr(0, str.find(':'));
+            func = nullptr;
+            for (const auto& f : funcs) {
+                if (!name.empty() && name == f.name) {
+                    func = &f;
+                }
+            }
+        } else if (entry.n_type == StabLine && func) {
+            lines.push_back(LineEntry { func->start + entry.n_value, entry.n_desc, file });
+        }
+    }
+    std::stable_sort(lines.begin(), lines.end(),
+        [](const LineEntry& a, const LineEntry& b) { return a.address < b.address; });
+    return lines;
+}
+
+bool gamecode::is_game_code(uintptr_t pc)
+{
+    for (const auto& gc : game_codes) {
+        if (gc.tcc && pc >= gc.code_begin && pc < gc.code_end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uintptr_t get_pc(const void* uctx)
+{
+    [[maybe_unused]] const auto uc = static_cast<const ucontext_t*>(uctx);
+#if defined(__linux__) && defined(__x86_64__)
+    return static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__linux__) && defined(__aarch64__)
+    return static_cast<uintptr_t>(uc->uc_mcontext.pc);
+#else
+    return 0;
+#endif
+}
+
+// The watchdog is a virtual (user CPU time) timer, so sitting in a debugger does not trigger it.
+static void arm_watchdog(uint32_t ms)
+{
+    itimerval timer = {};
+    timer.it_value.tv_sec = ms / 1000;
+    timer.it_value.tv_usec = (ms % 1000) * 1000;
+    setitimer(ITIMER_VIRTUAL, &timer, nullptr);
+}
+
+static void watchdog_handler(int sig, siginfo_t*, void* uctx)
+{
+    if (!in_callback) {
+        return;
+    }
+    const auto pc = get_pc(uctx);
+    if (pc && !gamecode::is_game_code(pc)) {
+        if (sig == InterruptSignal) {
+            return; // the main thread will try again
+        }
+        // Jumping out of engine code (or libc) might leave it in a broken state (e.g. a held
+        // lock in malloc), so we try again a little later, hoping to land in game code.
+        // If we are waiting for workers, they might be the ones stuck.
+        const auto num_workers = num_worker_threads.load();
+        for (size_t i = 0; i < num_workers; ++i) {
+            pthread_kill(worker_threads[i], InterruptSignal);
+        }
+        arm_watchdog(1);
+        return;
+    }
+    break_reason = gamecode::BreakReason::Timeout;
+    break_pc = pc;
+    siglongjmp(jump_buf, 1);
+}
+
+static void fault_handler(int sig, siginfo_t* info, void* uctx)
+{
+    if (!in_callback) {
+        // Not our business. Returning re-executes the faulting instruction, which will then crash.
+        signal(sig, SIG_DFL);
+        return;
+    }
+    break_reason = gamecode::BreakReason::Fault;
+    break_pc = get_pc(uctx);
+    fault_signal = sig;
+    fault_address = reinterpret_cast<uintptr_t>(info->si_addr);
+    siglongjmp(jump_buf, 1);
+}
+
+static void setup_signal_stack()
+{
+    // Infinite recursion will overflow the stack, so the handlers need their own
+    signal_stack = std::make_unique<std::byte[]>(SignalStackSize);
+    stack_t stack = {};
+    stack.ss_sp = signal_stack.get();
+    stack.ss_size = SignalStackSize;
+    sigaltstack(&stack, nullptr);
+}
+
+template <typename Func>
+static bool call_protected(Func&& func)
+{
+    if (sigsetjmp(jump_buf, 1)) {
+        in_callback = false;
+        arm_watchdog(0);
+        return true;
+    }
+    break_reason = gamecode::BreakReason::Break;
+    callback_stack_top = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    in_callback = true;
+    arm_watchdog(watchdog_budget_ms);
+    func();
+    arm_watchdog(0);
+    in_callback = false;
+    return false;
+}
 
 namespace gamecode {
-GameCode* load(const char* path)
+GameCode* load(
+    const char* path, const GameCode* previous, DependencyCallback* dep_callback, void* ctx)
 {
     size_t i = 0;
     while (i < game_codes.size() && game_codes[i].tcc != nullptr) {
@@ -37,22 +379,77 @@ GameCode* load(const char* path)
     assert(gc.tcc);
 
     tcc_set_output_type(gc.tcc, TCC_OUTPUT_MEMORY);
+    // Make tcc collect the included files in target_deps (like it does for a depfile)
+    tcc_set_options(gc.tcc, "-MD");
+    // For line info in fault messages
+    tcc_set_options(gc.tcc, "-g");
 
-    if (tcc_add_file(gc.tcc, path) == -1) {
+    const auto compile_res = tcc_add_file(gc.tcc, path);
+
+    if (dep_callback) {
+        for (int d = 0; d < gc.tcc->nb_target_deps; ++d) {
+            dep_callback(ctx, gc.tcc->target_deps[d]);
+        }
+    }
+
+    if (compile_res == -1) {
         fmt::println("compile failed");
         return nullptr;
     }
 
+    const auto funcs = hash_functions(gc.tcc);
+    gc.hash = hash_data(gc.tcc);
+    for (const auto& func : funcs) {
+        gc.hash = hash_str(gc.hash, func.name);
+        gc.hash = hash_value(gc.hash, func.hash);
+    }
+    gc.files.clear();
+    gc.lines = read_lines(gc.tcc, funcs, gc.files);
+
     // For runtime library libtcc1.
     // This is actually not fixed by tcc_set_lib_path, which would make sense.
     // Why is this runtime lib not already part of libtcc?
     tcc_add_library_path(gc.tcc, "build/tinycc/");
 
     tcc_add_symbol(gc.tcc, "ng_alloc", (const void*)ng_alloc);
+    tcc_add_symbol(gc.tcc, "ng_alloc_ex", (const void*)ng_alloc_ex);
+    tcc_add_symbol(gc.tcc, "ng_frame_alloc", (const void*)ng_frame_alloc);
     tcc_add_symbol(gc.tcc, "ng_load_image", (const void*)ng_load_image);
     tcc_add_symbol(gc.tcc, "ng_draw_sprite", (const void*)ng_draw_sprite);
+    tcc_add_symbol(gc.tcc, "ng_draw_sprites", (const void*)ng_draw_sprites);
+    tcc_add_symbol(gc.tcc, "ng_draw_sprites_mixed", (const void*)ng_draw_sprites_mixed);
+    tcc_add_symbol(gc.tcc, "ng_set_layer", (const void*)ng_set_layer);
+    tcc_add_symbol(gc.tcc, "ng_load_font", (const void*)ng_load_font);
+    tcc_add_symbol(gc.tcc, "ng_draw_text", (const void*)ng_draw_text);
+    tcc_add_symbol(gc.tcc, "ng_measure_text", (const void*)ng_measure_text);
     tcc_add_symbol(gc.tcc, "ng_is_key_down", (const void*)ng_is_key_down);
-    tcc_add_symbol(gc.tcc, "ng_random_float", (const void*)ng_randomf);
+    tcc_add_symbol(gc.tcc, "ng_key_pressed", (const void*)ng_key_pressed);
+    tcc_add_symbol(gc.tcc, "ng_key", (const void*)ng_key);
+    tcc_add_symbol(gc.tcc, "ng_is_key_down_id", (const void*)ng_is_key_down_id);
+    tcc_add_symbol(gc.tcc, "ng_key_pressed_id", (const void*)ng_key_pressed_id);
+    tcc_add_symbol(gc.tcc, "ng_randomf", (const void*)ng_randomf);
+    tcc_add_symbol(gc.tcc, "ng_pool_create", (const void*)ng_pool_create);
+    tcc_add_symbol(gc.tcc, "ng_pool_add", (const void*)ng_pool_add);
+    tcc_add_symbol(gc.tcc, "ng_pool_remove", (const void*)ng_pool_remove);
+    tcc_add_symbol(gc.tcc, "ng_pool_count", (const void*)ng_pool_count);
+    tcc_add_symbol(gc.tcc, "ng_pool_component", (const void*)ng_pool_component);
+    tcc_add_symbol(gc.tcc, "ng_tilemap_create", (const void*)ng_tilemap_create);
+    tcc_add_symbol(gc.tcc, "ng_tilemap_set", (const void*)ng_tilemap_set);
+    tcc_add_symbol(gc.tcc, "ng_tilemap_get", (const void*)ng_tilemap_get);
+    tcc_add_symbol(gc.tcc, "ng_tilemap_draw", (const void*)ng_tilemap_draw);
+    tcc_add_symbol(gc.tcc, "ng_spatial_clear", (const void*)ng_spatial_clear);
+    tcc_add_symbol(gc.tcc, "ng_spatial_insert", (const void*)ng_spatial_insert);
+    tcc_add_symbol(gc.tcc, "ng_spatial_query_radius", (const void*)ng_spatial_query_radius);
+    tcc_add_symbol(gc.tcc, "ng_bulk_integrate", (const void*)ng_bulk_integrate);
+    tcc_add_symbol(gc.tcc, "ng_bulk_distance", (const void*)ng_bulk_distance);
+    tcc_add_symbol(gc.tcc, "ng_bulk_clamp", (const void*)ng_bulk_clamp);
+    tcc_add_symbol(gc.tcc, "ng_bulk_lerp", (const void*)ng_bulk_lerp);
+    tcc_add_symbol(gc.tcc, "ng_bulk_circle_contains", (const void*)ng_bulk_circle_contains);
+    tcc_add_symbol(gc.tcc, "ng_randomf_r", (const void*)ng_randomf_r);
+    tcc_add_symbol(gc.tcc, "ng_random_stream", (const void*)ng_random_stream);
+    tcc_add_symbol(gc.tcc, "ng_randomf_stream", (const void*)ng_randomf_stream);
+    tcc_add_symbol(gc.tcc, "ng_random_fill", (const void*)ng_random_fill);
+    tcc_add_symbol(gc.tcc, "ng_parallel_for", (const void*)ng_parallel_for);
     tcc_add_symbol(gc.tcc, "ng_break_internal", (const void*)ng_break_internal);
     tcc_add_symbol(gc.tcc, "ng_timestamp_internal", (const void*)ng_timestamp_internal);
     tcc_add_symbol(gc.tcc, "ng_error_internal", (const void*)ng_error_internal);
@@ -62,13 +459,39 @@ GameCode* load(const char* path)
         return nullptr;
     }
 
-    gc.load = (LoadFunc*)tcc_get_symbol(gc.tcc, "load");
-    gc.update = (UpdateFunc*)tcc_get_symbol(gc.tcc, "update");
-    gc.render = (RenderFunc*)tcc_get_symbol(gc.tcc, "render");
+    const auto first_global = std::find_if(
+        funcs.begin(), funcs.end(), [](const FunctionInfo& func) { return func.global; });
+    if (first_global != funcs.end()) {
+        const auto text_addr
+            = reinterpret_cast<uintptr_t>(tcc_get_symbol(gc.tcc, first_global->name))
+            - first_global->start;
+        gc.code_begin = text_addr + funcs.front().start;
+        gc.code_end = text_addr + funcs.back().end;
+        gc.code.clear();
+        for (const auto& func : funcs) {
+            gc.code.push_back(
+                CodeRange { text_addr + func.start, text_addr + func.end, func.name });
+        }
+        for (auto& line : gc.lines) {
+            line.address += text_addr;
+        }
+    }
 
     fmt::println(
         "compiled new code in {}us", platform::get_perf_counter_elapsed(start, 1000 * 1000));
 
+    if (previous && gc.hash == previous->hash) {
+        // Nothing changed, so we can just keep using the previous version (and its globals)
+        fmt::println("game code unchanged");
+        tcc_delete(gc.tcc);
+        gc = GameCode {};
+        return const_cast<GameCode*>(previous);
+    }
+
+    gc.load = (LoadFunc*)tcc_get_symbol(gc.tcc, "load");
+    gc.update = (UpdateFunc*)tcc_get_symbol(gc.tcc, "update");
+    gc.render = (RenderFunc*)tcc_get_symbol(gc.tcc, "render");
+
     return &gc;
 }
 
@@ -79,31 +502,144 @@ void* load(GameCode* gc)
 
 bool update(GameCode* gc, void* state, float t, float dt)
 {
-    if (setjmp(jump_buf)) {
-        return true;
-    } else {
-        in_callback = true;
-        gc->update(state, t, dt);
-        in_callback = false;
-        return false;
-    }
+    return call_protected([&]() { gc->update(state, t, dt); });
 }
 
 bool render(GameCode* gc, const void* state)
 {
-    if (setjmp(jump_buf)) {
-        return true;
-    } else {
-        in_callback = true;
-        gc->render(state);
+    return call_protected([&]() { gc->render(state); });
+}
+
+bool call(void (*func)(void*), void* ctx)
+{
+    // This might be nested in an update/render call on the same thread (the main thread helps
+    // out with jobs), so the outer state has to be restored afterwards.
+    sigjmp_buf outer_jump_buf;
+    std::memcpy(outer_jump_buf, jump_buf, sizeof(sigjmp_buf));
+    const std::sig_atomic_t outer_in_callback = in_callback;
+    const uintptr_t outer_stack_top = callback_stack_top;
+    const auto restore = [&]() {
         in_callback = false;
-        return false;
+        std::memcpy(jump_buf, outer_jump_buf, sizeof(sigjmp_buf));
+        callback_stack_top = outer_stack_top;
+        in_callback = outer_in_callback;
+    };
+
+    if (sigsetjmp(jump_buf, 1)) {
+        restore();
+        return true;
     }
+    break_reason = BreakReason::Break;
+    if (!outer_in_callback) {
+        callback_stack_top = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    }
+    in_callback = true;
+    func(ctx);
+    restore();
+    return false;
+}
+
+BreakInfo get_break_info()
+{
+    return BreakInfo { break_reason, break_pc, Fault { fault_signal, fault_address } };
+}
+
+void forward_break(const BreakInfo& info)
+{
+    break_reason = info.reason;
+    break_pc = info.pc;
+    fault_signal = info.fault.signal;
+    fault_address = info.fault.address;
+    assert(in_callback);
+    siglongjmp(jump_buf, 1);
+}
+
+void set_watchdog_budget(uint32_t ms)
+{
+    watchdog_budget_ms = ms;
+}
+
+uint32_t get_watchdog_budget()
+{
+    return watchdog_budget_ms;
+}
+
+uintptr_t get_callback_stack_top()
+{
+    return in_callback ? callback_stack_top : 0;
+}
+
+SourceLocation lookup(uintptr_t address)
+{
+    for (const auto& gc : game_codes) {
+        if (!gc.tcc || address < gc.code_begin || address >= gc.code_end) {
+            continue;
+        }
+        SourceLocation loc;
+        const auto range = std::upper_bound(gc.code.begin(), gc.code.end(), address,
+            [](uintptr_t addr, const CodeRange& r) { return addr < r.begin; });
+        if (range != gc.code.begin() && address < std::prev(range)->end) {
+            loc.function = std::prev(range)->function.c_str();
+            loc.offset = address - std::prev(range)->begin;
+        }
+        const auto line = std::upper_bound(gc.lines.begin(), gc.lines.end(), address,
+            [](uintptr_t addr, const LineEntry& l) { return addr < l.address; });
+        if (line != gc.lines.begin()) {
+            loc.file = gc.files[std::prev(line)->file].c_str();
+            loc.line = std::prev(line)->line;
+        }
+        return loc;
+    }
+    return SourceLocation {};
+}
+
+void init()
+{
+    setup_signal_stack();
+
+    struct sigaction sa = {};
+    sa.sa_sigaction = watchdog_handler;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGVTALRM, &sa, nullptr);
+    sigaction(InterruptSignal, &sa, nullptr);
+
+    sa.sa_sigaction = fault_handler;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    for (const auto sig : { SIGSEGV, SIGBUS, SIGFPE, SIGILL }) {
+        sigaction(sig, &sa, nullptr);
+    }
+}
+
+void init_worker_thread()
+{
+    setup_signal_stack();
+    // The profiler samples workers too. The watchdog signal stays blocked.
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+
+    static std::mutex mutex;
+    std::lock_guard lock(mutex);
+    const auto idx = num_worker_threads.load();
+    assert(idx < worker_threads.size());
+    worker_threads[idx] = pthread_self();
+    num_worker_threads.store(idx + 1); // publish only after the slot is written
+}
+
+void block_timer_signals(bool block)
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGVTALRM);
+    sigaddset(&set, SIGPROF);
+    pthread_sigmask(block ? SIG_BLOCK : SIG_UNBLOCK, &set, nullptr);
 }
 
 void ng_break()
 {
     assert(in_callback);
-    std::longjmp(jump_buf, 1);
+    siglongjmp(jump_buf, 1);
 }
 }
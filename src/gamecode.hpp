@@ -1,12 +1,78 @@
 #pragma once
 
+#include <cstdint>
+
 struct GameCode;
 
 namespace gamecode {
-GameCode* load(const char* path);
+enum class BreakReason {
+    Break, // ng_break (or ng_error, ng_timestamp, ...)
+    Timeout, // the watchdog interrupted the call
+    Fault, // SIGSEGV, SIGBUS, SIGFPE or SIGILL
+};
+
+struct Fault {
+    int signal;
+    uintptr_t address; // si_addr, i.e. the faulting memory address (or instruction for SIGFPE)
+};
+
+struct BreakInfo {
+    BreakReason reason;
+    uintptr_t pc; // the game code address at which the call was interrupted (Timeout and Fault)
+    Fault fault; // only valid if reason is Fault
+};
+
+struct SourceLocation {
+    const char* function = nullptr; // nullptr if the address is not in game code
+    uintptr_t offset = 0; // from the start of function
+    const char* file = nullptr; // nullptr if there is no line info
+    int line = 0;
+};
+
+// Installs the signal handlers
+void init();
+// Must be called on every thread other than the main thread that calls game code (with call()).
+// It unblocks the profiler signal, so these threads are sampled too.
+void init_worker_thread();
+// The watchdog signal must be handled by the main thread and the profiler signal by threads that
+// run game code. Threads inherit the signal mask, so every other thread must be started between
+// block_timer_signals(true) and (false). Blocking them in the thread itself would leave a short
+// window in which they could land there.
+void block_timer_signals(bool block);
+
+// Called for every file that was read while compiling (the source file itself and all non-system
+// headers it includes).
+using DependencyCallback = void(void* ctx, const char* path);
+
+// If `previous` is passed and none of the code and data changed, `previous` is returned instead of
+// a new version. Otherwise the new version replaces it entirely.
+// The dependency callback is called even if compilation fails, so that a fix in a header can
+// trigger a recompile.
+GameCode* load(const char* path, const GameCode* previous = nullptr,
+    DependencyCallback* dep_callback = nullptr, void* ctx = nullptr);
 void* load(GameCode* gc);
 // These two return whether they were broken from
 bool update(GameCode* gc, void* s, float t, float dt);
 bool render(GameCode* gc, const void* s);
+// Calls func(ctx), which calls into game code, and returns whether it was broken from.
+// Unlike update/render it does not arm the watchdog. It's meant for jobs (see jobs.hpp) and can be
+// nested in an update/render call.
+bool call(void (*func)(void*), void* ctx);
+// Why the most recent call on this thread was broken from
+BreakInfo get_break_info();
+// Breaks from the current call with the given info, e.g. one that happened on a worker thread.
+[[noreturn]] void forward_break(const BreakInfo& info);
+// Maps an address in any loaded game code to a function and a source line
+SourceLocation lookup(uintptr_t address);
+
+// These are safe to call from a signal handler
+bool is_game_code(uintptr_t address);
+// While an update/render call is running on this thread, all game code stack frames are below
+// this address. Returns 0 if no update/render call is running.
+uintptr_t get_callback_stack_top();
+// If an update/render call takes more than `ms` milliseconds of CPU time (of all threads, including
+// jobs), it is interrupted and returns as if it was broken from. 0 disables the watchdog.
+void set_watchdog_budget(uint32_t ms);
+uint32_t get_watchdog_budget();
 void ng_break(); // only call this from an update/render callback!
 }
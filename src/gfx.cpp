@@ -0,0 +1,611 @@
+#include "gfx.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "atlas.hpp"
+#include "gamecode.hpp"
+#include "image.hpp"
+
+namespace gfx {
+struct Texture {
+    atlas::Region region;
+    float u0, v0, u1, v1;
+    std::string path;
+    uint64_t hash = 0; // of the file contents
+    uint32_t refcount = 0; // 0 means the slot is free
+};
+}
+
+struct PendingUpload {
+    uint32_t page, x, y, width, height;
+    std::vector<uint8_t> pixels;
+};
+
+struct Gfx {
+    std::unique_ptr<gfx::Backend> backend;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::array<bool, atlas::MaxNumPages> pages = {}; // whether the backend has created it
+    std::array<gfx::Texture, 64> textures;
+    // The queued sprites, the key is layer << 16 | page
+    std::vector<gfx::Quad> queue;
+    std::vector<uint32_t> keys;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> order_tmp;
+    std::vector<uint32_t> sorted_keys;
+    std::vector<gfx::Quad> sorted;
+    uint16_t layer = 0;
+    gfx::Texture* placeholder = nullptr;
+    gfx::FrameStats stats;
+    gfx::FrameStats last_stats;
+    gfx::CommandBuffer* capture = nullptr;
+    gfx::Backend* upload_mirror = nullptr;
+    uint64_t texture_generation = 0;
+    uint64_t frame = 0;
+    // update_texture calls, done at the next flush before any sprite is drawn
+    std::vector<PendingUpload> pending_uploads;
+
+    static Gfx& instance()
+    {
+        static Gfx gfx;
+        return gfx;
+    }
+};
+
+// Images are read and decoded on the loader threads. The results are uploaded on the main thread
+// in finish_loads.
+struct LoadRequest {
+    std::string path;
+    std::vector<uint64_t> cached_hashes; // of textures with this path, which need no decoding
+    gfx::LoadCallback* callback;
+    void* ctx;
+    uint64_t sequence;
+};
+
+struct LoadResult {
+    LoadRequest request;
+    uint64_t hash = 0;
+    bool failed = false;
+    std::optional<image::Image> image; // nullopt if the hash is in cached_hashes
+};
+
+struct Loader {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::condition_variable done_cv;
+    std::deque<LoadRequest> requests;
+    std::vector<LoadResult> results;
+    std::vector<std::thread> threads;
+    size_t num_pending = 0; // requests that don't have a result yet
+    bool quit = false;
+    // Only accessed on the main thread
+    uint64_t next_sequence = 0;
+    // Results of older requests with the same callback and ctx are dropped, because two loads of
+    // the same file (e.g. saved twice quickly) might finish out of order.
+    std::map<std::pair<gfx::LoadCallback*, void*>, uint64_t> latest;
+
+    static Loader& instance()
+    {
+        static Loader loader;
+        return loader;
+    }
+
+    ~Loader()
+    {
+        {
+            std::lock_guard lock(mutex);
+            quit = true;
+        }
+        cv.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+};
+
+struct NullBackend : gfx::Backend {
+    void begin_frame() override { }
+    void create_page(uint32_t) override { }
+    void upload(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, const uint8_t*) override { }
+    void draw(uint32_t, const gfx::Quad*, size_t) override { }
+    void end_frame() override { }
+};
+
+static void flush(Gfx& gfx);
+
+static void upload(Gfx& gfx, const atlas::Region& region, const image::Image& img)
+{
+    // Queued sprites might use what was there before
+    flush(gfx);
+    for (const auto backend : { gfx.backend.get(), gfx.upload_mirror }) {
+        if (!backend) {
+            continue;
+        }
+        if (!gfx.pages[region.page]) {
+            backend->create_page(region.page);
+        }
+        // The slot might have been used by a larger image before
+        backend->upload(region.page, region.slot_x, region.slot_y, region.slot_width,
+            region.slot_height, nullptr);
+        backend->upload(region.page, region.x, region.y, img.width, img.height, img.pixels.get());
+    }
+    gfx.pages[region.page] = true;
+    gfx.stats.uploads++;
+}
+
+static uint64_t hash_bytes(std::span<const uint8_t> data)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const auto b : data) {
+        hash = (hash ^ b) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static gfx::Texture* find_cached(std::string_view path, uint64_t hash)
+{
+    for (auto& tex : Gfx::instance().textures) {
+        if (tex.refcount > 0 && tex.hash == hash && tex.path == path) {
+            tex.refcount++;
+            return &tex;
+        }
+    }
+    return nullptr;
+}
+
+static gfx::Texture* create_texture(std::string_view path, uint64_t hash, const image::Image& img)
+{
+    auto& gfx = Gfx::instance();
+    size_t tex_idx = 0;
+    while (tex_idx < gfx.textures.size() && gfx.textures[tex_idx].refcount > 0) {
+        tex_idx++;
+    }
+    assert(tex_idx < gfx.textures.size());
+    // On hot reload this packs the new version into the free space of the existing pages
+    const auto region = atlas::allocate(img.width, img.height);
+    if (!region) {
+        fmt::println("Could not fit '{}' ({}x{}) into the atlas", path, img.width, img.height);
+        return nullptr;
+    }
+    upload(gfx, *region, img);
+
+    auto& tex = gfx.textures[tex_idx];
+    constexpr auto page_size = static_cast<float>(atlas::PageSize);
+    tex.region = *region;
+    tex.u0 = static_cast<float>(region->x) / page_size;
+    tex.v0 = static_cast<float>(region->y) / page_size;
+    tex.u1 = static_cast<float>(region->x + region->width) / page_size;
+    tex.v1 = static_cast<float>(region->y + region->height) / page_size;
+    tex.path = path;
+    tex.hash = hash;
+    tex.refcount = 1;
+    gfx.texture_generation++;
+    return &tex;
+}
+
+static void loader_main(Loader* loader)
+{
+    while (true) {
+        LoadRequest request;
+        {
+            std::unique_lock lock(loader->mutex);
+            loader->cv.wait(lock, [&]() { return loader->quit || !loader->requests.empty(); });
+            if (loader->quit) {
+                return;
+            }
+            request = std::move(loader->requests.front());
+            loader->requests.pop_front();
+        }
+
+        LoadResult res;
+        const auto data = image::read_file(request.path);
+        if (data) {
+            res.hash = hash_bytes(*data);
+            const auto& cached = request.cached_hashes;
+            if (std::find(cached.begin(), cached.end(), res.hash) == cached.end()) {
+                res.image = image::decode(*data, request.path);
+                res.failed = !res.image;
+            }
+        } else {
+            res.failed = true;
+        }
+        res.request = std::move(request);
+
+        {
+            std::lock_guard lock(loader->mutex);
+            loader->results.push_back(std::move(res));
+            loader->num_pending--;
+        }
+        loader->done_cv.notify_all();
+    }
+}
+
+// Stable LSD radix sort of the indices by key. Bytes that are the same in all keys are skipped, so
+// usually only one or two passes are needed.
+static void sort_by_key(
+    const std::vector<uint32_t>& keys, std::vector<uint32_t>* order, std::vector<uint32_t>* tmp)
+{
+    const auto n = keys.size();
+    std::array<std::array<uint32_t, 256>, 4> counts = {};
+    for (const auto key : keys) {
+        for (size_t d = 0; d < 4; ++d) {
+            counts[d][(key >> (d * 8)) & 0xff]++;
+        }
+    }
+
+    order->resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        (*order)[i] = static_cast<uint32_t>(i);
+    }
+    tmp->resize(n);
+    for (size_t d = 0; d < 4; ++d) {
+        const auto shift = d * 8;
+        if (counts[d][(keys[0] >> shift) & 0xff] == n) {
+            continue;
+        }
+        std::array<uint32_t, 256> offsets;
+        uint32_t sum = 0;
+        for (size_t b = 0; b < 256; ++b) {
+            offsets[b] = sum;
+            sum += counts[d][b];
+        }
+        for (const auto idx : *order) {
+            (*tmp)[offsets[(keys[idx] >> shift) & 0xff]++] = idx;
+        }
+        std::swap(*order, *tmp);
+    }
+}
+
+static void flush(Gfx& gfx)
+{
+    for (const auto& up : gfx.pending_uploads) {
+        for (const auto backend : { gfx.backend.get(), gfx.upload_mirror }) {
+            if (backend) {
+                backend->upload(up.page, up.x, up.y, up.width, up.height, up.pixels.data());
+            }
+        }
+        gfx.stats.uploads++;
+    }
+    gfx.pending_uploads.clear();
+
+    if (gfx.queue.empty()) {
+        return;
+    }
+
+    // Most of the time everything is on one layer and page and the sort can be skipped
+    const auto sorted = std::is_sorted(gfx.keys.begin(), gfx.keys.end());
+    const gfx::Quad* quads = gfx.queue.data();
+    if (!sorted) {
+        sort_by_key(gfx.keys, &gfx.order, &gfx.order_tmp);
+        gfx.sorted.resize(gfx.queue.size());
+        gfx.sorted_keys.resize(gfx.keys.size());
+        for (size_t i = 0; i < gfx.order.size(); ++i) {
+            gfx.sorted[i] = gfx.queue[gfx.order[i]];
+            gfx.sorted_keys[i] = gfx.keys[gfx.order[i]];
+        }
+        std::swap(gfx.keys, gfx.sorted_keys);
+        quads = gfx.sorted.data();
+    }
+
+    // Consecutive sprites on the same page are merged, even across layers
+    size_t start = 0;
+    while (start < gfx.queue.size()) {
+        const auto page = gfx.keys[start] & 0xffff;
+        auto end = start + 1;
+        while (end < gfx.queue.size() && (gfx.keys[end] & 0xffff) == page) {
+            end++;
+        }
+        gfx.backend->draw(page, quads + start, end - start);
+        if (gfx.capture) {
+            gfx.capture->draw(page, quads + start, end - start);
+        }
+        gfx.stats.draw_calls++;
+        gfx.stats.quads += static_cast<uint32_t>(end - start);
+        start = end;
+    }
+
+    gfx.queue.clear();
+    gfx.keys.clear();
+}
+
+static void push_quad(Gfx& gfx, const gfx::Texture& tex, float x, float y, float scale, float r,
+    float g, float b, float a)
+{
+    const auto hw = static_cast<float>(tex.region.width) * scale * 0.5f;
+    const auto hh = static_cast<float>(tex.region.height) * scale * 0.5f;
+    const auto x0 = x - hw;
+    const auto y0 = y - hh;
+    const auto x1 = x + hw;
+    const auto y1 = y + hh;
+    // Cull against the render target (and invisible sprites), so they are never sorted or submitted
+    if (!gfx::is_visible(x0, y0, x1, y1) || a <= 0.0f) {
+        gfx.stats.culled++;
+        return;
+    }
+    gfx.queue.push_back(gfx::Quad { x0, y0, x1, y1, tex.u0, tex.v0, tex.u1, tex.v1, r, g, b, a });
+    gfx.keys.push_back(static_cast<uint32_t>(gfx.layer) << 16 | tex.region.page);
+}
+
+namespace gfx {
+std::unique_ptr<Backend> make_null_backend()
+{
+    return std::make_unique<NullBackend>();
+}
+
+void init(std::unique_ptr<Backend> backend, uint32_t width, uint32_t height)
+{
+    auto& gfx = Gfx::instance();
+    gfx.backend = std::move(backend);
+    gfx.width = width;
+    gfx.height = height;
+}
+
+void shutdown()
+{
+    // The GL backend needs to be destroyed before the context
+    Gfx::instance().backend.reset();
+}
+
+void render_begin()
+{
+    auto& gfx = Gfx::instance();
+    gfx.layer = 0;
+    gfx.backend->begin_frame();
+}
+
+void render_end()
+{
+    auto& gfx = Gfx::instance();
+    flush(gfx);
+    gfx.backend->end_frame();
+    gfx.last_stats = gfx.stats;
+    gfx.stats = FrameStats {};
+    gfx.frame++;
+}
+
+FrameStats get_frame_stats()
+{
+    return Gfx::instance().last_stats;
+}
+
+uint64_t get_frame()
+{
+    return Gfx::instance().frame;
+}
+
+void set_upload_mirror(Backend* backend)
+{
+    auto& gfx = Gfx::instance();
+    assert(std::none_of(gfx.pages.begin(), gfx.pages.end(), [](bool p) { return p; }));
+    gfx.upload_mirror = backend;
+}
+
+void set_capture(CommandBuffer* buffer)
+{
+    auto& gfx = Gfx::instance();
+    // The queue so far belongs to the previous capture (or none)
+    flush(gfx);
+    gfx.capture = buffer;
+}
+
+void draw_commands(std::span<const std::byte> commands)
+{
+    auto& gfx = Gfx::instance();
+    flush(gfx);
+    replay(commands, gfx.backend.get());
+}
+
+uint64_t get_texture_generation()
+{
+    return Gfx::instance().texture_generation;
+}
+
+uint64_t create_debug_texture(uint32_t width, uint32_t height)
+{
+    return Gfx::instance().backend->create_debug_texture(width, height);
+}
+
+void update_debug_texture(uint64_t texture, uint32_t x, uint32_t y, const image::Image& img)
+{
+    Gfx::instance().backend->update_debug_texture(texture, x, y, img);
+}
+
+Texture* load_texture(std::string_view path)
+{
+    const auto data = image::read_file(path);
+    if (!data) {
+        return nullptr;
+    }
+    const auto hash = hash_bytes(*data);
+    if (const auto tex = find_cached(path, hash)) {
+        return tex;
+    }
+    const auto img = image::decode(*data, path);
+    if (!img) {
+        return nullptr;
+    }
+    return create_texture(path, hash, *img);
+}
+
+void load_texture_async(std::string_view path, LoadCallback* callback, void* ctx)
+{
+    auto& loader = Loader::instance();
+    if (loader.threads.empty()) {
+        // Decoding is mostly independent of the file system, so a couple threads help
+        const auto num_threads = std::clamp(std::thread::hardware_concurrency() / 4, 1u, 4u);
+        gamecode::block_timer_signals(true);
+        for (size_t i = 0; i < num_threads; ++i) {
+            loader.threads.emplace_back(loader_main, &loader);
+        }
+        gamecode::block_timer_signals(false);
+    }
+
+    LoadRequest request { std::string(path), {}, callback, ctx, loader.next_sequence++ };
+    for (const auto& tex : Gfx::instance().textures) {
+        if (tex.refcount > 0 && tex.path == path) {
+            request.cached_hashes.push_back(tex.hash);
+        }
+    }
+    loader.latest[{ callback, ctx }] = request.sequence;
+    {
+        std::lock_guard lock(loader.mutex);
+        loader.requests.push_back(std::move(request));
+        loader.num_pending++;
+    }
+    loader.cv.notify_one();
+}
+
+void finish_loads()
+{
+    auto& loader = Loader::instance();
+    std::vector<LoadResult> results;
+    {
+        std::lock_guard lock(loader.mutex);
+        results = std::move(loader.results);
+        loader.results.clear();
+    }
+    for (auto& res : results) {
+        const auto& req = res.request;
+        const auto latest = loader.latest.find({ req.callback, req.ctx });
+        assert(latest != loader.latest.end());
+        if (latest->second != req.sequence) {
+            continue; // superseded by a newer request
+        }
+        loader.latest.erase(latest);
+
+        Texture* tex = nullptr;
+        if (!res.failed) {
+            tex = find_cached(req.path, res.hash);
+            if (!tex && res.image) {
+                tex = create_texture(req.path, res.hash, *res.image);
+            } else if (!tex) {
+                // The cached texture was freed while this was loading
+                tex = load_texture(req.path);
+            }
+        }
+        req.callback(req.ctx, tex);
+    }
+}
+
+void wait_for_loads()
+{
+    auto& loader = Loader::instance();
+    {
+        std::unique_lock lock(loader.mutex);
+        loader.done_cv.wait(lock, [&]() { return loader.num_pending == 0; });
+    }
+    finish_loads();
+}
+
+Texture* get_placeholder_texture()
+{
+    auto& gfx = Gfx::instance();
+    if (!gfx.placeholder) {
+        // A single transparent pixel, so nothing shows up until the real image is there
+        image::Image img;
+        img.width = 1;
+        img.height = 1;
+        img.pixels = std::make_unique<uint8_t[]>(4);
+        gfx.placeholder = create_texture("<placeholder>", 0, img); // this reference is ours
+    }
+    gfx.placeholder->refcount++;
+    return gfx.placeholder;
+}
+
+Texture* create_empty_texture(uint32_t width, uint32_t height)
+{
+    image::Image img;
+    img.width = width;
+    img.height = height;
+    img.pixels = std::make_unique<uint8_t[]>(width * height * 4);
+    return create_texture("<empty>", 0, img);
+}
+
+void update_texture(Texture* texture, uint32_t x, uint32_t y, const image::Image& img)
+{
+    assert(texture->refcount > 0);
+    const auto& region = texture->region;
+    assert(x + img.width <= region.width && y + img.height <= region.height);
+    auto& gfx = Gfx::instance();
+    // Flushing here would draw the queued sprites before ones on lower layers that come later
+    const auto pixels = img.pixels.get();
+    gfx.pending_uploads.push_back(PendingUpload { region.page, region.x + x, region.y + y,
+        img.width, img.height, { pixels, pixels + img.width * img.height * 4 } });
+    gfx.texture_generation++;
+}
+
+TextureInfo get_texture_info(const Texture* texture)
+{
+    assert(texture->refcount > 0);
+    const auto& region = texture->region;
+    return TextureInfo { region.page, region.width, region.height, texture->u0, texture->v0,
+        texture->u1, texture->v1 };
+}
+
+bool is_visible(float x0, float y0, float x1, float y1)
+{
+    const auto& gfx = Gfx::instance();
+    return x1 > 0.0f && y1 > 0.0f && x0 < static_cast<float>(gfx.width)
+        && y0 < static_cast<float>(gfx.height);
+}
+
+void release_texture(Texture* texture)
+{
+    assert(texture->refcount > 0);
+    if (--texture->refcount == 0) {
+        // Queued sprites using it are fine, because the region is only reused after a flush
+        atlas::free(texture->region);
+        Gfx::instance().texture_generation++;
+    }
+}
+
+void set_layer(uint16_t layer)
+{
+    Gfx::instance().layer = layer;
+}
+
+void draw(const Texture* texture, float x, float y, float scale, float r, float g, float b, float a)
+{
+    assert(texture->refcount > 0);
+    push_quad(Gfx::instance(), *texture, x, y, scale, r, g, b, a);
+}
+
+void draw(const Texture* texture, const SpriteInstance* instances, size_t count, size_t stride)
+{
+    assert(texture->refcount > 0);
+    auto& gfx = Gfx::instance();
+    auto ptr = reinterpret_cast<const std::byte*>(instances);
+    for (size_t i = 0; i < count; ++i) {
+        const auto& inst = *reinterpret_cast<const SpriteInstance*>(ptr + i * stride);
+        push_quad(gfx, *texture, inst.x, inst.y, inst.scale, inst.r, inst.g, inst.b, inst.a);
+    }
+}
+
+void draw_quads(uint32_t page, std::span<const Quad> quads, float dx, float dy)
+{
+    auto& gfx = Gfx::instance();
+    const auto key = static_cast<uint32_t>(gfx.layer) << 16 | page;
+    for (auto q : quads) {
+        q.x0 += dx;
+        q.y0 += dy;
+        q.x1 += dx;
+        q.y1 += dy;
+        gfx.queue.push_back(q);
+    }
+    gfx.keys.insert(gfx.keys.end(), quads.size(), key);
+}
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "image.hpp"
+
+namespace gfx {
+// Everything is drawn as textured, axis-aligned rectangles. The coordinates are in pixels with the
+// origin in the top left, the texture coordinates are relative to the atlas page.
+struct Quad {
+    float x0, y0, x1, y1;
+    float u0, v0, u1, v1;
+    float r, g, b, a;
+};
+
+// The frontend below does the texture management and batching and hands the results to a backend.
+// Pages are atlas::PageSize squared and RGBA8.
+struct Backend {
+    virtual ~Backend() = default;
+    virtual void begin_frame() = 0;
+    // New pages start out transparent
+    virtual void create_page(uint32_t page) = 0;
+    // pixels is tightly packed. If it's nullptr, the rectangle is cleared to transparent.
+    virtual void upload(uint32_t page, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+        const uint8_t* pixels)
+        = 0;
+    // All quads are blended (src alpha, one minus src alpha) on top of what's there, in order
+    virtual void draw(uint32_t page, const Quad* quads, size_t count) = 0;
+    virtual void end_frame() = 0;
+    // Textures for the debug UI, outside of the atlas, so they don't change the texture generation.
+    // Returns an ImTextureID, or 0 if the backend has no debug UI.
+    virtual uint64_t create_debug_texture(uint32_t, uint32_t) { return 0; }
+    // Replaces the part of the texture at (x, y) with img
+    virtual void update_debug_texture(uint64_t, uint32_t, uint32_t, const image::Image&) { }
+};
+
+// Needs platform::init, the debug UI is drawn here too
+std::unique_ptr<Backend> make_gl_backend();
+// Does nothing, to measure everything except the GPU submission
+std::unique_ptr<Backend> make_null_backend();
+
+// A compact encoding of backend calls, which can be replayed into any backend
+struct CommandBuffer {
+    std::vector<std::byte> data;
+
+    void clear() { data.clear(); }
+    void create_page(uint32_t page);
+    void upload(uint32_t page, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+        const uint8_t* pixels);
+    void draw(uint32_t page, const Quad* quads, size_t count);
+};
+
+// Does not call begin_frame and end_frame, because a buffer might only be part of a frame
+void replay(std::span<const std::byte> commands, Backend* backend);
+
+// Records the calls of the current frame. Uploads are recorded separately, because they are needed
+// to replay any of the frames after them.
+struct RecordBackend : Backend {
+    CommandBuffer frame;
+    CommandBuffer uploads;
+
+    void begin_frame() override;
+    void create_page(uint32_t page) override;
+    void upload(uint32_t page, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+        const uint8_t* pixels) override;
+    void draw(uint32_t page, const Quad* quads, size_t count) override;
+    void end_frame() override;
+};
+
+// Rasterizes on the CPU into an image, to capture frames on machines without a GPU. It blends like
+// the GL backend, but samples the nearest texel instead of filtering linearly.
+struct SoftBackend : Backend {
+    image::Image framebuffer;
+    std::vector<std::unique_ptr<uint8_t[]>> pages;
+
+    SoftBackend(uint32_t width, uint32_t height);
+    void begin_frame() override;
+    void create_page(uint32_t page) override;
+    void upload(uint32_t page, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+        const uint8_t* pixels) override;
+    void draw(uint32_t page, const Quad* quads, size_t count) override;
+    void end_frame() override;
+};
+
+struct FrameStats {
+    uint32_t draw_calls = 0;
+    uint32_t quads = 0; // submitted to the backend
+    uint32_t culled = 0; // completely outside of the render target or transparent
+    uint32_t uploads = 0;
+};
+
+// width and height are the size of the render target in pixels
+void init(std::unique_ptr<Backend> backend, uint32_t width, uint32_t height);
+void shutdown();
+void render_begin();
+void render_end();
+// Of the last finished frame
+FrameStats get_frame_stats();
+// The number of frames finished with render_end
+uint64_t get_frame();
+
+// create_page and upload calls are also sent to this backend, e.g. to keep CPU copies of the
+// atlas. It has to be set before the first texture is created.
+void set_upload_mirror(Backend* backend);
+// While a buffer is set, all draws are also recorded into it. Pass nullptr to stop.
+void set_capture(CommandBuffer* buffer);
+// Draws recorded commands (with set_capture) in between render_begin and render_end
+void draw_commands(std::span<const std::byte> commands);
+// Changes whenever a texture is created, updated or freed. Recorded commands are only valid as long
+// as this stays the same, because they refer to places in the atlas and their contents.
+uint64_t get_texture_generation();
+// See Backend::create_debug_texture. They live as long as the backend.
+uint64_t create_debug_texture(uint32_t width, uint32_t height);
+void update_debug_texture(uint64_t texture, uint32_t x, uint32_t y, const image::Image& img);
+
+struct Texture;
+
+// The layout must match SpriteInstance in game/engine.h
+struct SpriteInstance {
+    float x, y, scale;
+    float r, g, b, a;
+};
+
+// Textures are cached by path and file contents, so loading an unchanged file again returns the
+// same texture. Every load_texture needs to be paired with a release_texture, the texture is freed
+// when the last reference is released.
+Texture* load_texture(std::string_view path);
+void release_texture(Texture* texture);
+// Reading and decoding happen on a background thread. The callback is called from finish_loads
+// with a new reference (like load_texture) or nullptr if loading failed.
+using LoadCallback = void(void* ctx, Texture* texture);
+void load_texture_async(std::string_view path, LoadCallback* callback, void* ctx);
+// Uploads all images that finished decoding and calls their callbacks. Call this once per frame.
+void finish_loads();
+// Like finish_loads, but waits for all pending loads first, so headless runs are deterministic
+void wait_for_loads();
+// Returns a new reference to an invisible texture to use until the real one is loaded
+Texture* get_placeholder_texture();
+
+// Returns a new reference to a transparent texture, to be filled in with update_texture, or
+// nullptr if it does not fit into the atlas
+Texture* create_empty_texture(uint32_t width, uint32_t height);
+// Replaces the part of the texture at (x, y) with img. This is done at the next flush, so every
+// sprite drawn in between sees the new contents, and the part must not have been drawn since the
+// last render_end. This changes the texture generation, like creating a texture.
+void update_texture(Texture* texture, uint32_t x, uint32_t y, const image::Image& img);
+
+// Where a texture is in the atlas, to build quads for parts of it (see draw_quads)
+struct TextureInfo {
+    uint32_t page;
+    uint32_t width, height; // in pixels
+    float u0, v0, u1, v1;
+
+    bool operator==(const TextureInfo&) const = default;
+};
+TextureInfo get_texture_info(const Texture* texture);
+// Whether any of the rectangle is inside the render target
+bool is_visible(float x0, float y0, float x1, float y1);
+// Sprites are queued and drawn sorted by layer (lowest first) and atlas page, so they need as few
+// draw calls as possible. Sprites on the same layer and page keep their order, but ones on
+// different pages may be reordered, so use layers for things that must overlap a certain way.
+// The layer is reset to 0 in render_begin.
+void set_layer(uint16_t layer);
+void draw(
+    const Texture* texture, float x, float y, float scale, float r, float g, float b, float a);
+// stride is the distance in bytes between two instances
+void draw(const Texture* texture, const SpriteInstance* instances, size_t count,
+    size_t stride = sizeof(SpriteInstance));
+// Queues prebuilt quads on the current layer, moved by (dx, dy). They are not culled, so check
+// is_visible for the whole group first.
+void draw_quads(uint32_t page, std::span<const Quad> quads, float dx, float dy);
+}
@@ -0,0 +1,263 @@
+#include "gfx.hpp"
+#include "glwx/texture.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "atlas.hpp"
+#include "core.hpp"
+
+#include "imgui.h"
+#include "imgui_impl_opengl3.h"
+#include "imgui_impl_sdl2.h"
+
+struct Vertex {
+    float x, y;
+    float u, v;
+    float r, g, b, a;
+};
+
+// The most quads we draw with one glDrawElements. Longer batches are split.
+constexpr size_t MaxDrawQuads = 4096;
+
+constexpr auto VertexShader = R"(
+#version 330 core
+uniform mat4 projection;
+layout(location = 0) in vec2 a_position;
+layout(location = 1) in vec2 a_texcoord;
+layout(location = 2) in vec4 a_color;
+out vec2 texcoord;
+out vec4 color;
+void main() {
+    texcoord = a_texcoord;
+    color = a_color;
+    gl_Position = projection * vec4(a_position, 0.0, 1.0);
+}
+)";
+
+constexpr auto FragmentShader = R"(
+#version 330 core
+uniform sampler2D tex;
+in vec2 texcoord;
+in vec4 color;
+out vec4 frag_color;
+void main() {
+    frag_color = texture(tex, texcoord) * color;
+}
+)";
+
+static GLuint compile_shader(GLenum type, const char* source)
+{
+    const auto shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        std::array<char, 1024> log;
+        glGetShaderInfoLog(shader, static_cast<GLsizei>(log.size()), nullptr, log.data());
+        fmt::println("Could not compile shader: {}", log.data());
+        assert(false);
+    }
+    return shader;
+}
+
+static GLuint link_program(const char* vert_source, const char* frag_source)
+{
+    const auto vert = compile_shader(GL_VERTEX_SHADER, vert_source);
+    const auto frag = compile_shader(GL_FRAGMENT_SHADER, frag_source);
+    const auto program = glCreateProgram();
+    glAttachShader(program, vert);
+    glAttachShader(program, frag);
+    glLinkProgram(program);
+    glDeleteShader(vert);
+    glDeleteShader(frag);
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        std::array<char, 1024> log;
+        glGetProgramInfoLog(program, static_cast<GLsizei>(log.size()), nullptr, log.data());
+        fmt::println("Could not link shader program: {}", log.data());
+        assert(false);
+    }
+    return program;
+}
+
+struct GlBackend : gfx::Backend {
+    GLuint program = 0;
+    GLint projection_location = -1;
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ibo = 0;
+    glm::mat4 projection;
+    std::array<GLuint, atlas::MaxNumPages> pages = {};
+    std::vector<GLuint> debug_textures;
+    std::vector<Vertex> vertices;
+
+    GlBackend()
+    {
+        const auto width = platform::get_window_width();
+        const auto height = platform::get_window_height();
+        // All GL state is set with plain GL calls (here and in ImGui), so
+        // glw::State's cache is not used at all. It would go stale otherwise.
+        glViewport(0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        projection
+            = glm::ortho(0.0f, static_cast<float>(width), static_cast<float>(height), 0.0f);
+        glDepthFunc(GL_ALWAYS);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        program = link_program(VertexShader, FragmentShader);
+        projection_location = glGetUniformLocation(program, "projection");
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "tex"), 0);
+
+        std::vector<uint16_t> indices;
+        indices.reserve(MaxDrawQuads * 6);
+        for (size_t q = 0; q < MaxDrawQuads; ++q) {
+            const auto base = static_cast<uint16_t>(q * 4);
+            for (const auto i : { 0, 1, 2, 2, 3, 0 }) {
+                indices.push_back(static_cast<uint16_t>(base + i));
+            }
+        }
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, MaxDrawQuads * 4 * sizeof(Vertex), nullptr, GL_STREAM_DRAW);
+        glGenBuffers(1, &ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * 2),
+            indices.data(), GL_STATIC_DRAW);
+        const auto stride = static_cast<GLsizei>(sizeof(Vertex));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, x));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, u));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, r));
+        glBindVertexArray(0);
+
+        vertices.reserve(MaxDrawQuads * 4);
+    }
+
+    ~GlBackend() override
+    {
+        glDeleteTextures(static_cast<GLsizei>(pages.size()), pages.data());
+        glDeleteTextures(static_cast<GLsizei>(debug_textures.size()), debug_textures.data());
+        glDeleteBuffers(1, &ibo);
+        glDeleteBuffers(1, &vbo);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteProgram(program);
+    }
+
+    void begin_frame() override
+    {
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplSDL2_NewFrame();
+        ImGui::NewFrame();
+    }
+
+    void create_page(uint32_t page) override
+    {
+        assert(!pages[page]);
+        // Start out transparent, so the padding between images is too
+        const std::vector<uint8_t> zeros(atlas::PageSize * atlas::PageSize * 4, 0);
+        glGenTextures(1, &pages[page]);
+        glBindTexture(GL_TEXTURE_2D, pages[page]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlas::PageSize, atlas::PageSize, 0, GL_RGBA,
+            GL_UNSIGNED_BYTE, zeros.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    void upload(uint32_t page, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+        const uint8_t* pixels) override
+    {
+        std::vector<uint8_t> zeros;
+        if (!pixels) {
+            zeros.resize(static_cast<size_t>(width) * height * 4, 0);
+            pixels = zeros.data();
+        }
+        glBindTexture(GL_TEXTURE_2D, pages[page]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(x), static_cast<GLint>(y),
+            static_cast<GLsizei>(width), static_cast<GLsizei>(height), GL_RGBA, GL_UNSIGNED_BYTE,
+            pixels);
+    }
+
+    void draw(uint32_t page, const gfx::Quad* quads, size_t count) override
+    {
+        glUseProgram(program);
+        glUniformMatrix4fv(projection_location, 1, GL_FALSE, &projection[0][0]);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, pages[page]);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        for (size_t start = 0; start < count; start += MaxDrawQuads) {
+            const auto n = std::min(count - start, MaxDrawQuads);
+            vertices.clear();
+            for (size_t i = start; i < start + n; ++i) {
+                const auto& q = quads[i];
+                vertices.push_back(Vertex { q.x0, q.y0, q.u0, q.v0, q.r, q.g, q.b, q.a });
+                vertices.push_back(Vertex { q.x1, q.y0, q.u1, q.v0, q.r, q.g, q.b, q.a });
+                vertices.push_back(Vertex { q.x1, q.y1, q.u1, q.v1, q.r, q.g, q.b, q.a });
+                vertices.push_back(Vertex { q.x0, q.y1, q.u0, q.v1, q.r, q.g, q.b, q.a });
+            }
+            const auto size = static_cast<GLsizeiptr>(vertices.size() * sizeof(Vertex));
+            // Orphan the buffer, so we don't wait for the previous draw to finish
+            glBufferData(
+                GL_ARRAY_BUFFER, MaxDrawQuads * 4 * sizeof(Vertex), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices.data());
+            glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(n * 6), GL_UNSIGNED_SHORT, nullptr);
+        }
+        glBindVertexArray(0);
+    }
+
+    void end_frame() override
+    {
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        platform::swap_window();
+    }
+
+    uint64_t create_debug_texture(uint32_t width, uint32_t height) override
+    {
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, static_cast<GLsizei>(width),
+            static_cast<GLsizei>(height), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        debug_textures.push_back(texture);
+        return texture;
+    }
+
+    void update_debug_texture(
+        uint64_t texture, uint32_t x, uint32_t y, const image::Image& img) override
+    {
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(texture));
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(x), static_cast<GLint>(y),
+            static_cast<GLsizei>(img.width), static_cast<GLsizei>(img.height), GL_RGBA,
+            GL_UNSIGNED_BYTE, img.pixels.get());
+    }
+};
+
+namespace gfx {
+std::unique_ptr<Backend> make_gl_backend()
+{
+    return std::make_unique<GlBackend>();
+}
+}
@@ -0,0 +1,122 @@
+#include "gfx.hpp"
+
+#include <cassert>
+#include <cstring>
+
+// Every command starts with its type and is followed by its payload. All sizes are multiples of 4,
+// so the quads in a buffer can be used in place.
+enum class CommandType : uint32_t { CreatePage, Upload, Draw };
+
+struct CreatePageCommand {
+    CommandType type;
+    uint32_t page;
+};
+
+struct UploadCommand {
+    CommandType type;
+    uint32_t page;
+    uint32_t x, y, width, height;
+    uint32_t has_pixels; // followed by width * height * 4 bytes of pixels if set
+};
+
+struct DrawCommand {
+    CommandType type;
+    uint32_t page;
+    uint32_t count; // followed by count quads
+};
+
+static_assert(sizeof(gfx::Quad) % 4 == 0);
+
+static void append(std::vector<std::byte>& data, const void* src, size_t size)
+{
+    const auto offset = data.size();
+    data.resize(offset + size);
+    std::memcpy(data.data() + offset, src, size);
+}
+
+template <typename T>
+static T read(std::span<const std::byte> commands, size_t offset)
+{
+    assert(offset + sizeof(T) <= commands.size());
+    T cmd;
+    std::memcpy(&cmd, commands.data() + offset, sizeof(T));
+    return cmd;
+}
+
+namespace gfx {
+void CommandBuffer::create_page(uint32_t page)
+{
+    const CreatePageCommand cmd { CommandType::CreatePage, page };
+    append(data, &cmd, sizeof(cmd));
+}
+
+void CommandBuffer::upload(
+    uint32_t page, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const uint8_t* pixels)
+{
+    const UploadCommand cmd { CommandType::Upload, page, x, y, width, height, pixels != nullptr };
+    append(data, &cmd, sizeof(cmd));
+    if (pixels) {
+        append(data, pixels, static_cast<size_t>(width) * height * 4);
+    }
+}
+
+void CommandBuffer::draw(uint32_t page, const Quad* quads, size_t count)
+{
+    const DrawCommand cmd { CommandType::Draw, page, static_cast<uint32_t>(count) };
+    append(data, &cmd, sizeof(cmd));
+    append(data, quads, count * sizeof(Quad));
+}
+
+void replay(std::span<const std::byte> commands, Backend* backend)
+{
+    size_t offset = 0;
+    while (offset < commands.size()) {
+        const auto type = read<CommandType>(commands, offset);
+        if (type == CommandType::CreatePage) {
+            const auto cmd = read<CreatePageCommand>(commands, offset);
+            offset += sizeof(cmd);
+            backend->create_page(cmd.page);
+        } else if (type == CommandType::Upload) {
+            const auto cmd = read<UploadCommand>(commands, offset);
+            offset += sizeof(cmd);
+            const uint8_t* pixels = nullptr;
+            if (cmd.has_pixels) {
+                pixels = reinterpret_cast<const uint8_t*>(commands.data() + offset);
+                offset += static_cast<size_t>(cmd.width) * cmd.height * 4;
+            }
+            backend->upload(cmd.page, cmd.x, cmd.y, cmd.width, cmd.height, pixels);
+        } else {
+            assert(type == CommandType::Draw);
+            const auto cmd = read<DrawCommand>(commands, offset);
+            offset += sizeof(cmd);
+            const auto quads = reinterpret_cast<const Quad*>(commands.data() + offset);
+            offset += cmd.count * sizeof(Quad);
+            backend->draw(cmd.page, quads, cmd.count);
+        }
+        assert(offset <= commands.size());
+    }
+}
+
+void RecordBackend::begin_frame()
+{
+    frame.clear();
+}
+
+void RecordBackend::create_page(uint32_t page)
+{
+    uploads.create_page(page);
+}
+
+void RecordBackend::upload(
+    uint32_t page, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const uint8_t* pixels)
+{
+    uploads.upload(page, x, y, width, height, pixels);
+}
+
+void RecordBackend::draw(uint32_t page, const Quad* quads, size_t count)
+{
+    frame.draw(page, quads, count);
+}
+
+void RecordBackend::end_frame() { }
+}
@@ -0,0 +1,238 @@
+#include "gfx.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "atlas.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SOFT_SSE2
+#endif
+
+// Blends a row of texels (picked by `columns`) tinted by `tint` onto dst, like
+// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) does on an RGBA8 target:
+// src = clamp(texel * tint, 0, 1), dst = src * src.a + dst * (1 - src.a).
+// Both versions do the same operations in the same order, so they give identical results (see
+// check_blend_paths).
+static void blend_row_scalar(uint8_t* dst, const uint8_t* texels, const uint32_t* columns,
+    size_t count, const float* tint)
+{
+    constexpr auto inv255 = 1.0f / 255.0f;
+    for (size_t i = 0; i < count; ++i) {
+        const auto texel = texels + columns[i] * 4;
+        if (texel[3] == 0) {
+            continue; // fully transparent, so dst stays the same
+        }
+        float src[4];
+        for (size_t c = 0; c < 4; ++c) {
+            // Same as maxps/minps
+            const auto v = static_cast<float>(texel[c]) * inv255 * tint[c];
+            const auto lo = v > 0.0f ? v : 0.0f;
+            src[c] = lo < 1.0f ? lo : 1.0f;
+        }
+        const auto alpha = src[3];
+        for (size_t c = 0; c < 4; ++c) {
+            const auto d = static_cast<float>(dst[i * 4 + c]) * inv255;
+            const auto out = src[c] * alpha + d * (1.0f - alpha);
+            dst[i * 4 + c] = static_cast<uint8_t>(std::nearbyint(out * 255.0f));
+        }
+    }
+}
+
+#ifdef SOFT_SSE2
+// Four pixels per iteration, with one register per channel (of all four pixels), so alpha does
+// not need to be broadcast. The rest is done by the scalar version.
+static void blend_row_sse2(uint8_t* dst, const uint8_t* texels, const uint32_t* columns,
+    size_t count, const float* tint)
+{
+    const auto vinv255 = _mm_set1_ps(1.0f / 255.0f);
+    const auto v255 = _mm_set1_ps(255.0f);
+    const auto zero = _mm_setzero_ps();
+    const auto one = _mm_set1_ps(1.0f);
+    const auto byte_mask = _mm_set1_epi32(0xff);
+    const __m128 vtint[4] = { _mm_set1_ps(tint[0]), _mm_set1_ps(tint[1]), _mm_set1_ps(tint[2]),
+        _mm_set1_ps(tint[3]) };
+
+    const auto channel = [byte_mask](__m128i pixels, int c) {
+        return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, c * 8), byte_mask));
+    };
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // There is no gather in SSE2
+        uint32_t t[4];
+        for (size_t j = 0; j < 4; ++j) {
+            std::memcpy(&t[j], texels + columns[i + j] * 4, 4);
+        }
+        const auto texel = _mm_set_epi32(static_cast<int>(t[3]), static_cast<int>(t[2]),
+            static_cast<int>(t[1]), static_cast<int>(t[0]));
+        // Lanes with a fully transparent texel keep dst, like the scalar version
+        const auto transparent = _mm_cmpeq_epi32(_mm_srli_epi32(texel, 24), _mm_setzero_si128());
+        if (_mm_movemask_epi8(transparent) == 0xffff) {
+            continue;
+        }
+        const auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+
+        __m128 src[4];
+        for (int c = 0; c < 4; ++c) {
+            const auto v = _mm_mul_ps(_mm_mul_ps(channel(texel, c), vinv255), vtint[c]);
+            src[c] = _mm_min_ps(_mm_max_ps(v, zero), one);
+        }
+        const auto alpha = src[3];
+        const auto inv_alpha = _mm_sub_ps(one, alpha);
+        auto out = _mm_setzero_si128();
+        for (int c = 0; c < 4; ++c) {
+            const auto d = _mm_mul_ps(channel(pixels, c), vinv255);
+            const auto o = _mm_add_ps(_mm_mul_ps(src[c], alpha), _mm_mul_ps(d, inv_alpha));
+            // Rounds to nearest even, like std::nearbyint. o is in [0, 1], so this fits a byte.
+            out = _mm_or_si128(out, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(o, v255)), c * 8));
+        }
+        out = _mm_or_si128(_mm_and_si128(transparent, pixels), _mm_andnot_si128(transparent, out));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), out);
+    }
+    blend_row_scalar(dst + i * 4, texels, columns + i, count - i, tint);
+}
+#endif
+
+static void blend_row(uint8_t* dst, const uint8_t* texels, const uint32_t* columns, size_t count,
+    const float* tint)
+{
+#ifdef SOFT_SSE2
+    blend_row_sse2(dst, texels, columns, count, tint);
+#else
+    blend_row_scalar(dst, texels, columns, count, tint);
+#endif
+}
+
+#if defined(SOFT_SSE2) && !defined(NDEBUG)
+// Blends the same random pixels with both versions and checks that they agree
+static bool check_blend_paths()
+{
+    constexpr size_t Count = 4096 + 3; // not a multiple of 4, so the tail is covered too
+    std::vector<uint8_t> texels(Count * 4);
+    std::vector<uint32_t> columns(Count);
+    std::vector<uint8_t> dst_sse(Count * 4);
+    uint32_t state = 12345;
+    const auto next = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<uint8_t>(state >> 24);
+    };
+    for (size_t i = 0; i < Count * 4; ++i) {
+        texels[i] = next();
+        dst_sse[i] = next();
+    }
+    for (size_t i = 0; i < Count; ++i) {
+        columns[i] = static_cast<uint32_t>((i * 7) % Count);
+        if (i % 5 == 0) {
+            texels[i * 4 + 3] = 0; // some transparent texels
+        }
+    }
+    auto dst_scalar = dst_sse;
+    for (const auto tint : { 1.0f, 0.5f, 1.7f, -0.25f }) {
+        const float tints[4] = { tint, 1.0f, 0.75f, tint * 0.5f + 0.5f };
+        blend_row_sse2(dst_sse.data(), texels.data(), columns.data(), Count, tints);
+        blend_row_scalar(dst_scalar.data(), texels.data(), columns.data(), Count, tints);
+    }
+    return dst_sse == dst_scalar;
+}
+#endif
+
+// The first pixel whose center is at or after `x`
+static int64_t first_pixel(float x)
+{
+    return static_cast<int64_t>(std::ceil(x - 0.5f));
+}
+
+static uint32_t texel_index(float t)
+{
+    const auto idx = static_cast<int64_t>(std::floor(t * static_cast<float>(atlas::PageSize)));
+    return static_cast<uint32_t>(std::clamp<int64_t>(idx, 0, atlas::PageSize - 1));
+}
+
+namespace gfx {
+SoftBackend::SoftBackend(uint32_t width, uint32_t height)
+    : pages(atlas::MaxNumPages)
+{
+    framebuffer.width = width;
+    framebuffer.height = height;
+    framebuffer.pixels = std::make_unique<uint8_t[]>(static_cast<size_t>(width) * height * 4);
+#if defined(SOFT_SSE2) && !defined(NDEBUG)
+    static const bool blend_paths_match = check_blend_paths();
+    assert(blend_paths_match);
+#endif
+}
+
+void SoftBackend::begin_frame()
+{
+    // Opaque black, like glClearColor in the GL backend
+    const auto num_pixels = static_cast<size_t>(framebuffer.width) * framebuffer.height;
+    const uint8_t black[4] = { 0, 0, 0, 255 };
+    for (size_t i = 0; i < num_pixels; ++i) {
+        std::memcpy(framebuffer.pixels.get() + i * 4, black, 4);
+    }
+}
+
+void SoftBackend::create_page(uint32_t page)
+{
+    assert(!pages[page]);
+    // make_unique zeroes, so the page is transparent
+    pages[page] = std::make_unique<uint8_t[]>(atlas::PageSize * atlas::PageSize * 4);
+}
+
+void SoftBackend::upload(
+    uint32_t page, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const uint8_t* pixels)
+{
+    assert(pages[page]);
+    assert(x + width <= atlas::PageSize && y + height <= atlas::PageSize);
+    for (size_t row = 0; row < height; ++row) {
+        const auto dst = pages[page].get() + ((y + row) * atlas::PageSize + x) * 4;
+        if (pixels) {
+            std::memcpy(dst, pixels + row * width * 4, width * 4);
+        } else {
+            std::memset(dst, 0, width * 4);
+        }
+    }
+}
+
+void SoftBackend::draw(uint32_t page, const Quad* quads, size_t count)
+{
+    assert(pages[page]);
+    const auto texels = pages[page].get();
+    const auto fb_width = static_cast<int64_t>(framebuffer.width);
+    const auto fb_height = static_cast<int64_t>(framebuffer.height);
+    std::vector<uint32_t> columns;
+    for (size_t i = 0; i < count; ++i) {
+        const auto& q = quads[i];
+        // Pixels are covered if their center is inside, with the top left edges inclusive
+        const auto px0 = std::max<int64_t>(first_pixel(q.x0), 0);
+        const auto px1 = std::min<int64_t>(first_pixel(q.x1), fb_width);
+        const auto py0 = std::max<int64_t>(first_pixel(q.y0), 0);
+        const auto py1 = std::min<int64_t>(first_pixel(q.y1), fb_height);
+        if (px0 >= px1 || py0 >= py1) {
+            continue;
+        }
+
+        const auto du = (q.u1 - q.u0) / (q.x1 - q.x0);
+        const auto dv = (q.v1 - q.v0) / (q.y1 - q.y0);
+        columns.resize(static_cast<size_t>(px1 - px0));
+        for (int64_t x = px0; x < px1; ++x) {
+            const auto u = q.u0 + (static_cast<float>(x) + 0.5f - q.x0) * du;
+            columns[static_cast<size_t>(x - px0)] = texel_index(u);
+        }
+        const float tint[4] = { q.r, q.g, q.b, q.a };
+        for (int64_t y = py0; y < py1; ++y) {
+            const auto v = q.v0 + (static_cast<float>(y) + 0.5f - q.y0) * dv;
+            const auto row = texels + static_cast<size_t>(texel_index(v)) * atlas::PageSize * 4;
+            const auto dst
+                = framebuffer.pixels.get() + static_cast<size_t>(y * fb_width + px0) * 4;
+            blend_row(dst, row, columns.data(), columns.size(), tint);
+        }
+    }
+}
+
+void SoftBackend::end_frame() { }
+}
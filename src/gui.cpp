@@ -1,11 +1,20 @@
+#include <algorithm>
+#include <cinttypes>
 #include <cstring>
+#include <functional>
+#include <optional>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "imgui.h"
 #include <fmt/core.h>
 
+#include "gfx.hpp"
+#include "memtrack.hpp"
+#include "profiler.hpp"
+#include "thumbnails.hpp"
 #include "vm.hpp"
 
 struct TypeMeta {
@@ -185,8 +194,22 @@ static void show_variable(Vm* vm, const TypeInfo& type_info, const std::string&
 void show_state_inspector(Vm* vm)
 {
     const auto& type_info = get_type_info();
-    ImGui::Begin("State Inspector", nullptr, 0);
-    show_variable(vm, type_info, "State", "state", reinterpret_cast<const std::byte*>(vm->state));
+    if (ImGui::Begin("State Inspector", nullptr, 0)) {
+        auto data = reinterpret_cast<const std::byte*>(vm->state);
+        // Seeking doesn't restore by itself, so the state is read from the snapshot instead. That
+        // way stepping through paused frames doesn't restore every frame just to show it.
+        static std::vector<std::byte> snapshot_state;
+        if (vm->restore_pending) {
+            snapshot_state.resize(get_meta(type_info, "State").size);
+            if (memtrack::read(
+                    vm->current_frame, vm->state, snapshot_state.size(), snapshot_state.data())) {
+                data = snapshot_state.data();
+            } else {
+                vm->ensure_restored();
+            }
+        }
+        show_variable(vm, type_info, "State", "state", data);
+    }
     ImGui::End();
 }
 
@@ -208,6 +231,7 @@ void show_overlay(const Vm* vm)
     ImGui::SetNextWindowBgAlpha(0.35f);
     if (ImGui::Begin("overlay", nullptr, window_flags)) {
         ImGui::Text("Mode: %s", Vm::to_string(vm->mode).data());
+        ImGui::Text("Seed: %" PRIu64, vm->seed);
         ImGui::Text("Current Frame: %u", vm->current_frame);
         ImGui::Text("Last Frame: %u", vm->last_frame);
         if (vm->replay_mark) {
@@ -269,3 +293,229 @@ void show_error(const Vm::Error& error)
     ImGui::Text("%s", error.message.c_str());
     ImGui::End();
 }
+
+static uint32_t get_tree_depth(const profiler::Node& node)
+{
+    uint32_t depth = 0;
+    for (const auto& child : node.children) {
+        depth = std::max(depth, get_tree_depth(child));
+    }
+    return depth + 1;
+}
+
+static ImU32 get_flame_color(const char* function)
+{
+    // Same function, same color
+    const auto hash = std::hash<std::string_view> {}(function ? function : "");
+    const auto r = 200 + static_cast<int>(hash % 56);
+    const auto g = 80 + static_cast<int>((hash >> 8) % 120);
+    return IM_COL32(r, g, 40, 255);
+}
+
+static void show_flame_node(
+    ImDrawList* draw_list, const profiler::Node& node, ImVec2 pos, float width, float row_height)
+{
+    float x = pos.x;
+    for (const auto& child : node.children) {
+        const auto w = width * static_cast<float>(child.samples) / static_cast<float>(node.samples);
+        const ImVec2 min { x, pos.y };
+        const ImVec2 max { x + w, pos.y + row_height };
+        const auto name = child.function ? child.function : "[engine]";
+        draw_list->AddRectFilled(min, max, get_flame_color(child.function));
+        draw_list->AddRect(min, max, IM_COL32(0, 0, 0, 255));
+        draw_list->PushClipRect(min, max, true);
+        draw_list->AddText(ImVec2 { min.x + 2.0f, min.y }, IM_COL32(0, 0, 0, 255), name);
+        draw_list->PopClipRect();
+        if (ImGui::IsMouseHoveringRect(min, max)) {
+            ImGui::SetTooltip("%s: %u samples (%.1f%%)", name, child.samples,
+                100.0f * static_cast<float>(child.samples)
+                    / static_cast<float>(profiler::get_num_samples()));
+        }
+        show_flame_node(draw_list, child, ImVec2 { x, pos.y + row_height }, w, row_height);
+        x += w;
+    }
+}
+
+void show_profiler()
+{
+    ImGui::Begin("Profiler", nullptr, 0);
+    bool enabled = profiler::is_enabled();
+    if (ImGui::Checkbox("Enabled", &enabled)) {
+        profiler::set_enabled(enabled);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) {
+        profiler::reset();
+    }
+    const auto num_samples = profiler::get_num_samples();
+    ImGui::SameLine();
+    ImGui::Text("%u samples", num_samples);
+
+    if (num_samples == 0) {
+        ImGui::End();
+        return;
+    }
+
+    const auto table_flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg
+        | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+    const auto table_height = ImGui::GetTextLineHeightWithSpacing() * 12.0f;
+    if (ImGui::BeginTable("hot spots", 4, table_flags, ImVec2 { 0.0f, table_height })) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Function");
+        ImGui::TableSetupColumn("Line");
+        ImGui::TableSetupColumn("Samples");
+        ImGui::TableSetupColumn("%");
+        ImGui::TableHeadersRow();
+        for (const auto& hs : profiler::get_hot_spots()) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(hs.function ? hs.function : "[engine]");
+            ImGui::TableNextColumn();
+            if (hs.file) {
+                ImGui::Text("%s:%d", hs.file, hs.line);
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", hs.samples);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f",
+                100.0f * static_cast<float>(hs.samples) / static_cast<float>(num_samples));
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::Separator();
+    const auto& tree = profiler::get_call_tree();
+    const auto row_height = ImGui::GetTextLineHeightWithSpacing();
+    const auto width = ImGui::GetContentRegionAvail().x;
+    const auto pos = ImGui::GetCursorScreenPos();
+    show_flame_node(ImGui::GetWindowDrawList(), tree, pos, width, row_height);
+    ImGui::Dummy(ImVec2 { width, row_height * static_cast<float>(get_tree_depth(tree) - 1) });
+    ImGui::End();
+}
+
+// All thumbnails live in one texture, one cell per slot
+constexpr uint32_t ThumbnailColumns = 32;
+constexpr uint32_t ThumbnailRows = thumbnails::MaxNumThumbnails / ThumbnailColumns;
+static_assert(ThumbnailColumns * ThumbnailRows == thumbnails::MaxNumThumbnails);
+
+struct ThumbnailTexture {
+    uint64_t texture = 0;
+    std::array<uint64_t, thumbnails::MaxNumThumbnails> versions = {};
+};
+
+// Returns 0 if the backend can't show it
+static uint64_t update_thumbnail_texture(const std::vector<thumbnails::Thumbnail>& thumbs)
+{
+    static ThumbnailTexture tex;
+    const auto w = thumbnails::get_width();
+    const auto h = thumbnails::get_height();
+    if (!tex.texture) {
+        tex.texture = gfx::create_debug_texture(w * ThumbnailColumns, h * ThumbnailRows);
+        if (!tex.texture) {
+            return 0;
+        }
+    }
+    for (const auto& thumb : thumbs) {
+        if (tex.versions[thumb.slot] == thumb.version) {
+            continue;
+        }
+        const auto x = (thumb.slot % ThumbnailColumns) * w;
+        const auto y = (thumb.slot / ThumbnailColumns) * h;
+        gfx::update_debug_texture(tex.texture, x, y, *thumb.image);
+        tex.versions[thumb.slot] = thumb.version;
+    }
+    return tex.texture;
+}
+
+static void show_thumbnail(uint64_t texture, uint32_t slot, float scale)
+{
+    const auto col = static_cast<float>(slot % ThumbnailColumns);
+    const auto row = static_cast<float>(slot / ThumbnailColumns);
+    const ImVec2 uv0 { col / ThumbnailColumns, row / ThumbnailRows };
+    const ImVec2 uv1 { (col + 1.0f) / ThumbnailColumns, (row + 1.0f) / ThumbnailRows };
+    const ImVec2 size { static_cast<float>(thumbnails::get_width()) * scale,
+        static_cast<float>(thumbnails::get_height()) * scale };
+    ImGui::Image(static_cast<ImTextureID>(texture), size, uv0, uv1);
+}
+
+// Draws the frame again at a bigger size, instead of scaling up its thumbnail. Returns false if the
+// frame can't be drawn anymore.
+static bool show_preview(uint32_t frame)
+{
+    static uint64_t texture = 0;
+    static std::optional<std::pair<uint32_t, uint64_t>> uploaded; // frame and stamp
+    const auto preview = thumbnails::get_preview(frame);
+    if (!preview) {
+        return false;
+    }
+    const auto& img = *preview->image;
+    if (!texture) {
+        texture = gfx::create_debug_texture(img.width, img.height);
+        if (!texture) {
+            return false;
+        }
+    }
+    if (uploaded != std::pair { preview->frame, preview->stamp }) {
+        gfx::update_debug_texture(texture, 0, 0, img);
+        uploaded = std::pair { preview->frame, preview->stamp };
+    }
+    ImGui::Image(static_cast<ImTextureID>(texture),
+        ImVec2 { static_cast<float>(img.width), static_cast<float>(img.height) });
+    return true;
+}
+
+void show_timeline(Vm* vm)
+{
+    const auto thumbs = thumbnails::get_all();
+    if (thumbs.empty()) {
+        return;
+    }
+    const auto texture = update_thumbnail_texture(thumbs);
+    if (!texture) {
+        return;
+    }
+
+    const ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration
+        | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing
+        | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_HorizontalScrollbar;
+    const ImGuiViewport* viewport = ImGui::GetMainViewport();
+    const auto& style = ImGui::GetStyle();
+    const auto height = static_cast<float>(thumbnails::get_height()) + style.WindowPadding.y * 2.0f
+        + style.ScrollbarSize;
+    ImGui::SetNextWindowPos({ viewport->WorkPos.x, viewport->WorkPos.y + viewport->WorkSize.y },
+        ImGuiCond_Always, ImVec2 { 0.0f, 1.0f });
+    ImGui::SetNextWindowSize({ viewport->WorkSize.x, height }, ImGuiCond_Always);
+    ImGui::SetNextWindowBgAlpha(0.35f);
+    if (ImGui::Begin("timeline", nullptr, window_flags)) {
+        for (size_t i = 0; i < thumbs.size(); ++i) {
+            const auto& thumb = thumbs[i];
+            const auto next_frame
+                = i + 1 < thumbs.size() ? thumbs[i + 1].frame : vm->last_frame + 1;
+            const auto is_current = vm->current_frame >= thumb.frame
+                && vm->current_frame < next_frame;
+            if (i > 0) {
+                ImGui::SameLine();
+            }
+            show_thumbnail(texture, thumb.slot, 1.0f);
+            if (is_current) {
+                ImGui::GetWindowDrawList()->AddRect(ImGui::GetItemRectMin(),
+                    ImGui::GetItemRectMax(), IM_COL32(255, 255, 0, 255));
+            }
+            if (ImGui::IsItemHovered()) {
+                // Only shows the frame, the state is only restored when clicking
+                ImGui::BeginTooltip();
+                ImGui::Text("Frame %u", thumb.frame);
+                if (!show_preview(thumb.frame)) {
+                    constexpr auto scale = static_cast<float>(thumbnails::Scale)
+                        / static_cast<float>(thumbnails::PreviewScale);
+                    show_thumbnail(texture, thumb.slot, scale);
+                }
+                ImGui::EndTooltip();
+            }
+            if (ImGui::IsItemClicked() && vm->mode == Vm::Mode::Pause) {
+                vm->seek(thumb.frame);
+            }
+        }
+    }
+    ImGui::End();
+}
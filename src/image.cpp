@@ -0,0 +1,127 @@
+#include "image.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fmt/core.h>
+
+// glwrap uses stb_image for glwx::makeTexture2D, but it's compiled into glwx, so we need our own
+// (static, so they don't collide) copy of the implementation.
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+namespace image {
+std::optional<std::vector<uint8_t>> read_file(std::string_view path)
+{
+    const auto path_str = std::string(path);
+    auto f = std::fopen(path_str.c_str(), "rb");
+    if (!f) {
+        fmt::println("Could not open '{}'", path);
+        return std::nullopt;
+    }
+    std::vector<uint8_t> data;
+    std::array<uint8_t, 64 * 1024> buf;
+    size_t n = 0;
+    while ((n = std::fread(buf.data(), 1, buf.size(), f)) > 0) {
+        data.insert(data.end(), buf.begin(), buf.begin() + static_cast<ptrdiff_t>(n));
+    }
+    std::fclose(f);
+    return data;
+}
+
+std::optional<Image> decode(std::span<const uint8_t> data, std::string_view name)
+{
+    int width = 0, height = 0, channels = 0;
+    const auto pixels = stbi_load_from_memory(
+        data.data(), static_cast<int>(data.size()), &width, &height, &channels, 4);
+    if (!pixels) {
+        fmt::println("Could not decode '{}': {}", name, stbi_failure_reason());
+        return std::nullopt;
+    }
+    Image img;
+    img.width = static_cast<uint32_t>(width);
+    img.height = static_cast<uint32_t>(height);
+    const auto size = static_cast<size_t>(img.width) * img.height * 4;
+    img.pixels = std::make_unique<uint8_t[]>(size);
+    std::memcpy(img.pixels.get(), pixels, size);
+    stbi_image_free(pixels);
+    return img;
+}
+
+std::optional<Image> load(std::string_view path)
+{
+    const auto data = read_file(path);
+    if (!data) {
+        return std::nullopt;
+    }
+    return decode(*data, path);
+}
+
+static bool write_ppm(const std::string& path, const Image& img)
+{
+    auto f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    std::fprintf(f, "P6\n%u %u\n255\n", img.width, img.height);
+    std::vector<uint8_t> row(static_cast<size_t>(img.width) * 3);
+    bool ok = true;
+    for (size_t y = 0; y < img.height && ok; ++y) {
+        const auto src = img.pixels.get() + y * img.width * 4;
+        for (size_t x = 0; x < img.width; ++x) {
+            std::memcpy(&row[x * 3], &src[x * 4], 3);
+        }
+        ok = std::fwrite(row.data(), 1, row.size(), f) == row.size();
+    }
+    std::fclose(f);
+    return ok;
+}
+
+bool write(std::string_view path, const Image& img)
+{
+    const auto path_str = std::string(path);
+    bool ok = false;
+    if (path.ends_with(".png")) {
+        ok = stbi_write_png(path_str.c_str(), static_cast<int>(img.width),
+                 static_cast<int>(img.height), 4, img.pixels.get(), static_cast<int>(img.width * 4))
+            != 0;
+    } else if (path.ends_with(".ppm")) {
+        ok = write_ppm(path_str, img);
+    } else {
+        fmt::println("Unknown image format: '{}'", path);
+        return false;
+    }
+    if (!ok) {
+        fmt::println("Could not write '{}'", path);
+    }
+    return ok;
+}
+
+size_t compare(const Image& a, const Image& b, uint8_t tolerance)
+{
+    if (a.width != b.width || a.height != b.height) {
+        return std::max(static_cast<size_t>(a.width) * a.height,
+            static_cast<size_t>(b.width) * b.height);
+    }
+    const auto num_pixels = static_cast<size_t>(a.width) * a.height;
+    size_t num_different = 0;
+    for (size_t i = 0; i < num_pixels; ++i) {
+        for (size_t c = 0; c < 3; ++c) {
+            const auto d = std::abs(static_cast<int>(a.pixels[i * 4 + c]) - b.pixels[i * 4 + c]);
+            if (d > tolerance) {
+                num_different++;
+                break;
+            }
+        }
+    }
+    return num_different;
+}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Decoded images, always RGBA8 (not premultiplied)
+namespace image {
+struct Image {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::unique_ptr<uint8_t[]> pixels; // width * height * 4 bytes, row by row from the top
+};
+
+std::optional<std::vector<uint8_t>> read_file(std::string_view path);
+// `name` is only used for error messages
+std::optional<Image> decode(std::span<const uint8_t> data, std::string_view name);
+std::optional<Image> load(std::string_view path);
+// The format depends on the extension: .png or .ppm (which drops alpha)
+bool write(std::string_view path, const Image& img);
+// Returns the number of pixels in which a color channel differs by more than `tolerance`. Alpha is
+// ignored, because PPM doesn't have it. If the sizes differ, all pixels differ.
+size_t compare(const Image& a, const Image& b, uint8_t tolerance);
+}
@@ -0,0 +1,209 @@
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gamecode.hpp"
+
+// Every thread owns a contiguous range of chunks, packed as (begin << 32 | end). It takes chunks
+// from the front of its own range and steals from the back of the others' ranges, so owner and
+// thief only fight over the last chunk.
+struct Slot {
+    alignas(64) std::atomic<uint64_t> range = 0;
+};
+
+struct Pool {
+    std::vector<std::thread> threads;
+    std::unique_ptr<Slot[]> slots; // slot 0 belongs to the thread calling parallel_for
+    size_t num_slots = 0;
+
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    uint64_t generation = 0;
+    size_t num_busy = 0;
+    bool quit = false;
+
+    // The current parallel_for
+    jobs::ChunkFunc* func = nullptr;
+    void* ctx = nullptr;
+    size_t count = 0;
+    size_t grain = 0;
+    std::atomic<size_t>* skip_from = nullptr;
+
+    static Pool& instance()
+    {
+        static Pool pool;
+        return pool;
+    }
+
+    ~Pool()
+    {
+        {
+            std::lock_guard lock(mutex);
+            quit = true;
+        }
+        start_cv.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+};
+
+thread_local bool running_chunk = false;
+
+static uint64_t pack(uint64_t begin, uint64_t end)
+{
+    return begin << 32 | end;
+}
+
+static bool take_front(Slot& slot, uint32_t& chunk)
+{
+    auto range = slot.range.load();
+    while (true) {
+        const auto begin = static_cast<uint32_t>(range >> 32);
+        const auto end = static_cast<uint32_t>(range);
+        if (begin >= end) {
+            return false;
+        }
+        if (slot.range.compare_exchange_weak(range, pack(begin + 1, end))) {
+            chunk = begin;
+            return true;
+        }
+    }
+}
+
+static bool take_back(Slot& slot, uint32_t& chunk)
+{
+    auto range = slot.range.load();
+    while (true) {
+        const auto begin = static_cast<uint32_t>(range >> 32);
+        const auto end = static_cast<uint32_t>(range);
+        if (begin >= end) {
+            return false;
+        }
+        if (slot.range.compare_exchange_weak(range, pack(begin, end - 1))) {
+            chunk = end - 1;
+            return true;
+        }
+    }
+}
+
+static void run_chunk(Pool& pool, uint32_t chunk)
+{
+    const auto begin = chunk * pool.grain;
+    if (begin >= pool.skip_from->load()) {
+        return;
+    }
+    const auto end = std::min(begin + pool.grain, pool.count);
+    running_chunk = true;
+    pool.func(pool.ctx, begin, end);
+    running_chunk = false;
+}
+
+static void run_slot(Pool& pool, size_t idx)
+{
+    uint32_t chunk = 0;
+    while (true) {
+        bool found = take_front(pool.slots[idx], chunk);
+        for (size_t i = 1; i < pool.num_slots && !found; ++i) {
+            found = take_back(pool.slots[(idx + i) % pool.num_slots], chunk);
+        }
+        // Ranges only ever shrink, so if there is nothing left now, there never will be
+        if (!found) {
+            return;
+        }
+        run_chunk(pool, chunk);
+    }
+}
+
+static void worker_main(Pool* pool, size_t idx)
+{
+    gamecode::init_worker_thread();
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(pool->mutex);
+            pool->start_cv.wait(
+                lock, [&]() { return pool->quit || pool->generation != generation; });
+            if (pool->quit) {
+                return;
+            }
+            generation = pool->generation;
+        }
+        run_slot(*pool, idx);
+        {
+            std::lock_guard lock(pool->mutex);
+            pool->num_busy--;
+        }
+        pool->done_cv.notify_one();
+    }
+}
+
+static void start_threads(Pool& pool)
+{
+    // The main thread is the remaining one
+    constexpr size_t MaxNumThreads = 64;
+    const auto hw = static_cast<size_t>(std::thread::hardware_concurrency());
+    const auto num_threads = std::min(hw > 1 ? hw - 1 : 0, MaxNumThreads - 1);
+    pool.num_slots = num_threads + 1;
+    pool.slots = std::make_unique<Slot[]>(pool.num_slots);
+
+    gamecode::block_timer_signals(true);
+    for (size_t i = 0; i < num_threads; ++i) {
+        pool.threads.emplace_back(worker_main, &pool, i + 1);
+    }
+    gamecode::block_timer_signals(false);
+}
+
+namespace jobs {
+void parallel_for(
+    size_t count, size_t grain, ChunkFunc* func, void* ctx, std::atomic<size_t>* skip_from)
+{
+    assert(!running_chunk); // no nesting
+    assert(grain > 0);
+    if (count == 0) {
+        return;
+    }
+    auto& pool = Pool::instance();
+    if (!pool.slots) {
+        start_threads(pool);
+    }
+
+    const auto num_chunks = (count + grain - 1) / grain;
+    assert(num_chunks <= UINT32_MAX);
+    // Contiguous ranges, so every thread mostly works on neighboring data
+    for (size_t s = 0; s < pool.num_slots; ++s) {
+        pool.slots[s].range.store(
+            pack(num_chunks * s / pool.num_slots, num_chunks * (s + 1) / pool.num_slots));
+    }
+
+    {
+        std::lock_guard lock(pool.mutex);
+        pool.func = func;
+        pool.ctx = ctx;
+        pool.count = count;
+        pool.grain = grain;
+        pool.skip_from = skip_from;
+        pool.num_busy = pool.num_slots - 1;
+        pool.generation++;
+    }
+    pool.start_cv.notify_all();
+
+    run_slot(pool, 0);
+
+    std::unique_lock lock(pool.mutex);
+    pool.done_cv.wait(lock, [&]() { return pool.num_busy == 0; });
+}
+
+bool in_job()
+{
+    return running_chunk;
+}
+}
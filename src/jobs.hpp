@@ -0,0 +1,19 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// A small work-stealing thread pool for data-parallel loops in game code.
+namespace jobs {
+using ChunkFunc = void(void* ctx, size_t begin, size_t end);
+
+// Splits [0, count) into chunks of `grain` indices and calls func for each chunk, on the worker
+// threads and the calling thread. The chunks only depend on `count` and `grain`, only which thread
+// runs them varies. Returns when all chunks are done.
+// Chunks starting at or after `*skip_from` are skipped. func may lower it to cancel the rest.
+// The threads are started on first use.
+void parallel_for(
+    size_t count, size_t grain, ChunkFunc* func, void* ctx, std::atomic<size_t>* skip_from);
+// Whether the calling thread is currently running a chunk
+bool in_job();
+}
@@ -0,0 +1,116 @@
+#include "kernels.hpp"
+
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define KERNELS_SSE2
+#endif
+
+// The vectorized loops only process multiples of 4 and the scalar loops do the rest (or
+// everything if SSE2 is not available). Keep the operations in the same order in both, so the
+// results are bit-identical.
+
+namespace kernels {
+void integrate(float* x, float* y, const float* vx, const float* vy, size_t count, float dt)
+{
+    size_t i = 0;
+#ifdef KERNELS_SSE2
+    const auto vdt = _mm_set1_ps(dt);
+    for (; i + 4 <= count; i += 4) {
+        const auto nx = _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(_mm_loadu_ps(vx + i), vdt));
+        const auto ny = _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(_mm_loadu_ps(vy + i), vdt));
+        _mm_storeu_ps(x + i, nx);
+        _mm_storeu_ps(y + i, ny);
+    }
+#endif
+    for (; i < count; ++i) {
+        x[i] = x[i] + vx[i] * dt;
+        y[i] = y[i] + vy[i] * dt;
+    }
+}
+
+void distance_to_point(const float* x, const float* y, size_t count, float px, float py, float* out)
+{
+    size_t i = 0;
+#ifdef KERNELS_SSE2
+    const auto vpx = _mm_set1_ps(px);
+    const auto vpy = _mm_set1_ps(py);
+    for (; i + 4 <= count; i += 4) {
+        const auto dx = _mm_sub_ps(_mm_loadu_ps(x + i), vpx);
+        const auto dy = _mm_sub_ps(_mm_loadu_ps(y + i), vpy);
+        const auto d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        _mm_storeu_ps(out + i, _mm_sqrt_ps(d2));
+    }
+#endif
+    for (; i < count; ++i) {
+        const auto dx = x[i] - px;
+        const auto dy = y[i] - py;
+        out[i] = std::sqrt(dx * dx + dy * dy);
+    }
+}
+
+void clamp(float* values, size_t count, float min, float max)
+{
+    size_t i = 0;
+#ifdef KERNELS_SSE2
+    const auto vmin = _mm_set1_ps(min);
+    const auto vmax = _mm_set1_ps(max);
+    for (; i + 4 <= count; i += 4) {
+        const auto v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + i), vmin), vmax);
+        _mm_storeu_ps(values + i, v);
+    }
+#endif
+    for (; i < count; ++i) {
+        // Same as maxps/minps (including NaN handling)
+        const auto v = values[i] > min ? values[i] : min;
+        values[i] = v < max ? v : max;
+    }
+}
+
+void lerp(const float* a, const float* b, size_t count, float t, float* out)
+{
+    size_t i = 0;
+#ifdef KERNELS_SSE2
+    const auto vt = _mm_set1_ps(t);
+    for (; i + 4 <= count; i += 4) {
+        const auto va = _mm_loadu_ps(a + i);
+        const auto diff = _mm_sub_ps(_mm_loadu_ps(b + i), va);
+        _mm_storeu_ps(out + i, _mm_add_ps(va, _mm_mul_ps(diff, vt)));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = a[i] + (b[i] - a[i]) * t;
+    }
+}
+
+size_t circle_contains(
+    float cx, float cy, float radius, const float* x, const float* y, size_t count, uint8_t* out)
+{
+    const auto r2 = radius * radius;
+    size_t inside = 0;
+    size_t i = 0;
+#ifdef KERNELS_SSE2
+    const auto vcx = _mm_set1_ps(cx);
+    const auto vcy = _mm_set1_ps(cy);
+    const auto vr2 = _mm_set1_ps(r2);
+    for (; i + 4 <= count; i += 4) {
+        const auto dx = _mm_sub_ps(_mm_loadu_ps(x + i), vcx);
+        const auto dy = _mm_sub_ps(_mm_loadu_ps(y + i), vcy);
+        const auto d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        const auto mask = _mm_movemask_ps(_mm_cmple_ps(d2, vr2));
+        for (size_t j = 0; j < 4; ++j) {
+            out[i + j] = static_cast<uint8_t>((mask >> j) & 1);
+            inside += out[i + j];
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        const auto dx = x[i] - cx;
+        const auto dy = y[i] - cy;
+        out[i] = dx * dx + dy * dy <= r2;
+        inside += out[i];
+    }
+    return inside;
+}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Bulk operations over float arrays (structure of arrays) for game code, since tcc does not
+// vectorize anything. They are vectorized with SSE2 and produce the same results as the scalar
+// versions, so they don't break determinism.
+namespace kernels {
+// x += vx * dt, y += vy * dt
+void integrate(float* x, float* y, const float* vx, const float* vy, size_t count, float dt);
+// out = distance of (x, y) to (px, py)
+void distance_to_point(
+    const float* x, const float* y, size_t count, float px, float py, float* out);
+void clamp(float* values, size_t count, float min, float max);
+// out = a + (b - a) * t
+void lerp(const float* a, const float* b, size_t count, float t, float* out);
+// out = 1 if (x, y) is within `radius` of (cx, cy), otherwise 0.
+// Returns the number of points inside.
+size_t circle_contains(
+    float cx, float cy, float radius, const float* x, const float* y, size_t count, uint8_t* out);
+}
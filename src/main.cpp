@@ -1,24 +1,42 @@
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 
 #include "imgui.h"
 #include <fmt/core.h>
 
 #include "engine.hpp"
 #include "fswatcher.hpp"
+#include "gamecode.hpp"
 #include "memtrack.hpp"
+#include "profiler.hpp"
+#include "thumbnails.hpp"
 #include "vm.hpp"
 
 void show_state_inspector(Vm* vm);
 void show_overlay(const Vm* vm);
 void show_error(const Vm::Error& error);
+void show_profiler();
+void show_timeline(Vm* vm);
+
+constexpr uint32_t Width = 960;
+constexpr uint32_t Height = 1080;
 
 void render_debug(Vm* vm)
 {
     gfx::render_begin();
-    vm->render();
+    if (vm->mode == Vm::Mode::Pause) {
+        vm->render_paused();
+    } else {
+        vm->render();
+    }
     show_overlay(vm);
     show_state_inspector(vm);
+    show_profiler();
+    show_timeline(vm);
     // ImGui::ShowDemoWindow();
     if (vm->error) {
         show_error(*vm->error);
@@ -26,14 +44,190 @@ void render_debug(Vm* vm)
     gfx::render_end();
 }
 
-int main(int, char**)
+struct HeadlessOptions {
+    uint32_t num_frames = 0;
+    const gfx::RecordBackend* recorder = nullptr;
+    const gfx::SoftBackend* soft = nullptr;
+    // Frames are written to/compared with <dir>/frame_<number>.ppm (only with the soft backend)
+    std::string capture_dir;
+    std::string golden_dir;
+};
+
+// The soft backend is deterministic, this only allows for differences in rounding between compilers
+constexpr uint8_t GoldenTolerance = 2;
+
+static std::string frame_path(std::string_view dir, uint32_t frame)
+{
+    return fmt::format("{}/frame_{:05}.ppm", dir, frame);
+}
+
+// Returns false if the frame does not match the golden image
+static bool check_frame(const HeadlessOptions& options, uint32_t frame)
+{
+    const auto& fb = options.soft->framebuffer;
+    if (!options.capture_dir.empty()) {
+        image::write(frame_path(options.capture_dir, frame), fb);
+    }
+    if (!options.golden_dir.empty()) {
+        const auto golden = image::load(frame_path(options.golden_dir, frame));
+        if (!golden) {
+            return false;
+        }
+        const auto num_different = image::compare(fb, *golden, GoldenTolerance);
+        if (num_different > 0) {
+            fmt::println("frame {} differs from the golden image in {} pixels", frame,
+                num_different);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Advances a fixed number of frames without input as fast as possible and prints how long update
+// and render took. Loads are waited for, so every run draws the same frames.
+int run_headless(Vm* vm, const HeadlessOptions& options)
 {
-    platform::init("Game VM", 960, 1080);
-    gfx::init();
+    const auto num_frames = options.num_frames;
+    const auto recorder = options.recorder;
+    uint32_t num_mismatches = 0;
+    const platform::InputState input_state;
+    constexpr float dt = 1.0f / 60.0f;
+    uint64_t update_time = 0;
+    uint64_t render_time = 0;
+    uint64_t draw_calls = 0;
+    uint64_t quads = 0;
+    uint64_t culled = 0;
+    uint64_t recorded_bytes = 0;
+    for (uint32_t frame = 0; frame < num_frames; ++frame) {
+        gfx::wait_for_loads();
+
+        const auto update_start = platform::get_perf_counter();
+        const auto update_broken = vm->update_advance(input_state, dt);
+        const auto render_start = platform::get_perf_counter();
+        gfx::render_begin();
+        const auto render_broken = vm->render();
+        gfx::render_end();
+        const auto render_end = platform::get_perf_counter();
+        vm->finish_frame_advance();
+
+        if (update_broken || render_broken) {
+            fmt::println("break in frame {}: {}", frame, vm->error ? vm->error->message : "");
+            return 1;
+        }
+
+        update_time += render_start - update_start;
+        render_time += render_end - render_start;
+        const auto stats = gfx::get_frame_stats();
+        draw_calls += stats.draw_calls;
+        quads += stats.quads;
+        culled += stats.culled;
+        if (recorder) {
+            recorded_bytes += recorder->frame.data.size();
+        }
+        if (options.soft && !check_frame(options, frame)) {
+            num_mismatches++;
+        }
+    }
+
+    const auto per_frame_us = [&](uint64_t ticks) {
+        return static_cast<double>(ticks) * 1000.0 * 1000.0
+            / static_cast<double>(platform::get_perf_counter_freq())
+            / static_cast<double>(std::max(num_frames, 1u));
+    };
+    const auto per_frame = [&](uint64_t v) {
+        return static_cast<double>(v) / static_cast<double>(std::max(num_frames, 1u));
+    };
+    fmt::println("{} frames, per frame: update {:.1f}us, render {:.1f}us, {:.1f} draw calls, "
+                 "{:.1f} quads, {:.1f} culled",
+        num_frames, per_frame_us(update_time), per_frame_us(render_time), per_frame(draw_calls),
+        per_frame(quads), per_frame(culled));
+    if (recorder) {
+        fmt::println("recorded {:.1f} bytes per frame, {} bytes of uploads",
+            per_frame(recorded_bytes), recorder->uploads.data.size());
+    }
+    if (!options.golden_dir.empty()) {
+        fmt::println("{} of {} frames match the golden images", num_frames - num_mismatches,
+            num_frames);
+    }
+    return num_mismatches > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    std::optional<uint64_t> seed;
+    std::optional<uint32_t> headless_frames;
+    std::string_view backend_name = "gl";
+    HeadlessOptions headless;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--watchdog" && i + 1 < argc) {
+            // milliseconds, 0 disables the watchdog
+            gamecode::set_watchdog_budget(
+                static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--headless" && i + 1 < argc) {
+            // run this many frames without a window and exit
+            headless_frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            if (backend_name == "gl") {
+                backend_name = "null";
+            }
+        } else if (arg == "--backend" && i + 1 < argc) {
+            // gl, null, record or soft
+            backend_name = argv[++i];
+        } else if (arg == "--capture" && i + 1 < argc) {
+            headless.capture_dir = argv[++i];
+        } else if (arg == "--golden" && i + 1 < argc) {
+            headless.golden_dir = argv[++i];
+        } else {
+            fmt::println("Unknown argument: {}", arg);
+            return 1;
+        }
+    }
+
+    if (headless_frames && backend_name == "gl") {
+        fmt::println("The GL backend needs a window");
+        return 1;
+    }
+    if (!headless_frames && backend_name != "gl") {
+        // The debug UI is drawn by the GL backend
+        fmt::println("Only the GL backend can run interactively, use --headless");
+        return 1;
+    }
+    if ((!headless.capture_dir.empty() || !headless.golden_dir.empty()) && backend_name != "soft") {
+        fmt::println("Capturing frames needs the soft backend");
+        return 1;
+    }
+
+    if (backend_name == "gl") {
+        platform::init("Game VM", Width, Height);
+        gfx::init(gfx::make_gl_backend(), Width, Height);
+        thumbnails::init(Width, Height);
+    } else if (backend_name == "null") {
+        gfx::init(gfx::make_null_backend(), Width, Height);
+    } else if (backend_name == "record") {
+        auto backend = std::make_unique<gfx::RecordBackend>();
+        headless.recorder = backend.get();
+        gfx::init(std::move(backend), Width, Height);
+    } else if (backend_name == "soft") {
+        auto backend = std::make_unique<gfx::SoftBackend>(Width, Height);
+        headless.soft = backend.get();
+        gfx::init(std::move(backend), Width, Height);
+    } else {
+        fmt::println("Unknown backend: {}", backend_name);
+        return 1;
+    }
 
     Vm vm;
     set_ng_vm(&vm);
-    vm.init("game/game.c");
+    vm.init("game/game.c", seed);
+
+    if (headless_frames) {
+        headless.num_frames = *headless_frames;
+        const auto res = run_headless(&vm, headless);
+        gfx::shutdown();
+        return res;
+    }
 
     platform::InputState input_state;
 
@@ -47,6 +241,9 @@ int main(int, char**)
         // will do what it is supposed to. If we don't want wo to use the new code, we will restore
         // first anyways.
         const auto reloaded = fsw::update();
+        gfx::finish_loads();
+        // Most of the frame time is spent waiting for vsync anyways
+        thumbnails::update(vm.last_frame, 2.0f);
 
         if (vm.replay_mark && reloaded) {
             vm.start_replay(*vm.replay_mark);
@@ -71,7 +268,7 @@ int main(int, char**)
         } else if (vm.mode == Vm::Mode::Pause) {
             // Do NOT update, so we don't play sounds or something while seeking
 
-            // Just render and handle input (later)
+            // Just draw (usually without rendering, see render_paused) and handle input (later)
             render_debug(&vm);
         } else if (vm.mode == Vm::Mode::Playback) {
             vm.update_playback();
@@ -87,6 +284,8 @@ int main(int, char**)
             vm.finish_frame_replay();
         }
 
+        profiler::collect();
+
         // Handle input
         const auto ctrl = input_state.is_down("left ctrl") || input_state.is_down("right ctrl");
         const auto shift = input_state.is_down("left shift") || input_state.is_down("right shift");
@@ -100,8 +299,8 @@ int main(int, char**)
                 // skip forward
                 if (vm.current_frame == vm.last_frame) {
                     // advance one with last inputs
-                    // We have restored the engine state from last_frame above
-                    // (in the Pause update), so we will kepe the last inputs.
+                    // update_time restores the engine state of last_frame if a seek is
+                    // pending (otherwise it's still current), so we keep the last inputs.
                     // We also keep the last code, but you can replay.
                     vm.update_time(dt);
                     vm.update();
@@ -117,7 +316,7 @@ int main(int, char**)
                 fmt::println("current frame: {}", vm.current_frame);
             } else if (input_state.is_pressed("e")) {
                 // skip to last frame
-                vm.current_frame = vm.last_frame;
+                vm.seek(vm.last_frame);
                 fmt::println("current frame: {}", vm.current_frame);
             } else if (input_state.is_pressed("c")) {
                 // continue from here
@@ -136,7 +335,7 @@ int main(int, char**)
                 }
             } else if (ctrl && input_state.is_pressed("m") && vm.replay_mark) {
                 // jump to mark
-                vm.current_frame = *vm.replay_mark;
+                vm.seek(*vm.replay_mark);
                 fmt::println("current frame: {}", vm.current_frame);
             } else if (input_state.is_pressed("m")) {
                 // mark / unmark
@@ -164,5 +363,6 @@ int main(int, char**)
         }
     }
 
+    gfx::shutdown();
     platform::shutdown();
 }
@@ -7,15 +7,19 @@
 #include <memory>
 #include <vector>
 
+#include <sys/mman.h>
+
 #include <fmt/core.h>
 
 struct TrackedRegion {
     void* ptr;
     size_t size;
+    memtrack::Policy policy;
+    bool is_protected;
 };
 
 struct RegionMemory {
-    std::unique_ptr<std::byte[]> data;
+    std::unique_ptr<std::byte[]> data; // nullptr if the region is not volatile
     size_t size;
 };
 
@@ -26,7 +30,8 @@ struct Snapshot {
 constexpr size_t ChunkSize = 64;
 using Chunk = std::array<std::byte, ChunkSize>;
 
-std::array<TrackedRegion, 8> tracked_regions = {};
+// Every ng_alloc and every pool is a region
+std::array<TrackedRegion, 64> tracked_regions = {};
 
 std::list<Snapshot>& get_snapshots()
 {
@@ -43,14 +48,33 @@ size_t num_tracked_regions()
     return i;
 }
 
+// Copies a volatile region into the snapshot. Immutable regions are write-protected instead.
+static void save_region(TrackedRegion& region, RegionMemory& mem)
+{
+    mem.size = region.size;
+    if (region.policy == memtrack::Policy::Volatile) {
+        if (!mem.data) {
+            mem.data = std::make_unique<std::byte[]>(region.size);
+        }
+        std::memcpy(mem.data.get(), region.ptr, region.size);
+    } else if (region.policy == memtrack::Policy::Immutable && !region.is_protected) {
+        // From here on, writes fault instead of silently diverging from the snapshots
+        if (mprotect(region.ptr, region.size, PROT_READ) == 0) {
+            region.is_protected = true;
+        } else {
+            fmt::println("Could not write-protect immutable memory at {}", region.ptr);
+        }
+    }
+}
+
 namespace memtrack {
 
-uint32_t track(void* ptr, size_t size)
+uint32_t track(void* ptr, size_t size, Policy policy)
 {
     const auto idx = num_tracked_regions();
     fmt::println("track {} bytes", size);
     assert(idx < tracked_regions.size());
-    tracked_regions[idx] = TrackedRegion { ptr, size };
+    tracked_regions[idx] = TrackedRegion { ptr, size, policy, false };
     return static_cast<uint32_t>(idx);
 }
 
@@ -61,10 +85,7 @@ uint32_t save()
     const auto num_regions = num_tracked_regions();
     snap.regions = std::vector<RegionMemory>(num_regions);
     for (size_t i = 0; i < num_regions; ++i) {
-        auto& region = tracked_regions[i];
-        snap.regions[i].data = std::make_unique<std::byte[]>(region.size);
-        snap.regions[i].size = region.size;
-        std::memcpy(snap.regions[i].data.get(), region.ptr, region.size);
+        save_region(tracked_regions[i], snap.regions[i]);
     }
     return id;
 }
@@ -75,12 +96,14 @@ void restore(uint32_t snapshot_id)
     auto snap = get_snapshots().begin();
     std::advance(snap, snapshot_id);
 
-    const auto num_regions = num_tracked_regions();
-    assert(snap->regions.size() <= num_regions);
-    for (size_t i = 0; i < num_regions; ++i) {
+    // Regions tracked after the snapshot was saved are left alone
+    assert(snap->regions.size() <= num_tracked_regions());
+    for (size_t i = 0; i < snap->regions.size(); ++i) {
         auto& region = tracked_regions[i];
         assert(region.size == snap->regions[i].size);
-        std::memcpy(region.ptr, snap->regions[i].data.get(), region.size);
+        if (snap->regions[i].data) {
+            std::memcpy(region.ptr, snap->regions[i].data.get(), region.size);
+        }
     }
 }
 
@@ -91,6 +114,11 @@ void restore_to(uint32_t track_id, uint32_t snapshot_id, size_t offset, size_t s
     std::advance(snap, snapshot_id);
 
     assert(track_id < snap->regions.size());
+    if (tracked_regions[track_id].policy == Policy::Immutable) {
+        std::memcpy(dest, static_cast<std::byte*>(tracked_regions[track_id].ptr) + offset, size);
+        return;
+    }
+    assert(snap->regions[track_id].data);
     std::memcpy(dest, snap->regions[track_id].data.get() + offset, size);
 }
 
@@ -100,13 +128,49 @@ void overwrite(uint32_t id)
     auto snap = get_snapshots().begin();
     std::advance(snap, id);
 
+    // Regions tracked after the snapshot was saved (e.g. a pool created during a replay) are added
+    // to it, like save would have done
     const auto num_regions = num_tracked_regions();
-    assert(snap->regions.size() == num_regions);
+    assert(snap->regions.size() <= num_regions);
+    snap->regions.resize(num_regions);
     for (size_t i = 0; i < num_regions; ++i) {
-        auto& region = tracked_regions[i];
-        assert(region.size == snap->regions[i].size);
-        std::memcpy(snap->regions[i].data.get(), region.ptr, region.size);
+        assert(!snap->regions[i].data || tracked_regions[i].size == snap->regions[i].size);
+        save_region(tracked_regions[i], snap->regions[i]);
+    }
+}
+
+bool read(uint32_t snapshot_id, const void* ptr, size_t size, void* dest)
+{
+    assert(snapshot_id < get_snapshots().size());
+    auto snap = get_snapshots().begin();
+    std::advance(snap, snapshot_id);
+
+    const auto addr = reinterpret_cast<uintptr_t>(ptr);
+    for (size_t i = 0; i < snap->regions.size(); ++i) {
+        const auto& region = tracked_regions[i];
+        const auto begin = reinterpret_cast<uintptr_t>(region.ptr);
+        if (addr < begin || addr + size > begin + region.size) {
+            continue;
+        }
+        // Only volatile regions differ between snapshots
+        const auto src = snap->regions[i].data ? snap->regions[i].data.get() + (addr - begin)
+                                               : static_cast<const std::byte*>(ptr);
+        std::memcpy(dest, src, size);
+        return true;
+    }
+    return false;
+}
+
+bool is_protected(uintptr_t address)
+{
+    for (size_t i = 0; i < num_tracked_regions(); ++i) {
+        const auto& region = tracked_regions[i];
+        const auto begin = reinterpret_cast<uintptr_t>(region.ptr);
+        if (region.is_protected && address >= begin && address < begin + region.size) {
+            return true;
+        }
     }
+    return false;
 }
 
 }
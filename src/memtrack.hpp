@@ -2,9 +2,22 @@
 #include <cstdint>
 
 namespace memtrack {
-uint32_t track(void* ptr, size_t size); // returns track id
+enum class Policy {
+    Volatile, // saved in every snapshot
+    // Never saved, because it does not change. It's made read-only when the first snapshot after
+    // tracking it is saved, so it must start on a page and not share its last page with anything.
+    Immutable,
+    Transient, // neither saved nor restored
+};
+
+uint32_t track(void* ptr, size_t size, Policy policy = Policy::Volatile); // returns track id
 uint32_t save(); // save and return new snapshot id
 void restore(uint32_t snapshot_id);
 void restore_to(uint32_t track_id, uint32_t snapshot_id, size_t offset, size_t size, void* dest);
 void overwrite(uint32_t id);
+// Copies `size` bytes at `ptr` as they are in the snapshot, without restoring anything. Returns
+// false if the memory is not in a region that is part of the snapshot.
+bool read(uint32_t snapshot_id, const void* ptr, size_t size, void* dest);
+// Whether the address is in an immutable region that has been made read-only
+bool is_protected(uintptr_t address);
 }
@@ -0,0 +1,74 @@
+#include "pool.hpp"
+
+#include <cassert>
+#include <cstring>
+
+static size_t align(size_t v)
+{
+    return (v + pool::Alignment - 1) & ~(pool::Alignment - 1);
+}
+
+static std::byte* get_element(pool::Pool* p, uint32_t component, uint32_t index)
+{
+    return reinterpret_cast<std::byte*>(p) + p->offsets[component]
+        + static_cast<size_t>(index) * p->sizes[component];
+}
+
+namespace pool {
+size_t get_size(uint32_t capacity, const uint32_t* sizes, uint32_t num_components)
+{
+    size_t size = align(sizeof(Pool));
+    for (uint32_t c = 0; c < num_components; ++c) {
+        size += align(static_cast<size_t>(capacity) * sizes[c]);
+    }
+    return size;
+}
+
+Pool* init(void* memory, uint32_t capacity, const uint32_t* sizes, uint32_t num_components)
+{
+    assert(reinterpret_cast<uintptr_t>(memory) % Alignment == 0);
+    assert(num_components > 0 && num_components <= MaxComponents);
+    auto p = static_cast<Pool*>(memory);
+    p->capacity = capacity;
+    p->count = 0;
+    p->num_components = num_components;
+    size_t offset = align(sizeof(Pool));
+    for (uint32_t c = 0; c < num_components; ++c) {
+        assert(sizes[c] > 0);
+        assert(offset <= UINT32_MAX);
+        p->sizes[c] = sizes[c];
+        p->offsets[c] = static_cast<uint32_t>(offset);
+        offset += align(static_cast<size_t>(capacity) * sizes[c]);
+    }
+    return p;
+}
+
+uint32_t add(Pool* pool)
+{
+    assert(pool->count < pool->capacity);
+    const auto idx = pool->count++;
+    // The slot might still contain a removed element
+    for (uint32_t c = 0; c < pool->num_components; ++c) {
+        std::memset(get_element(pool, c, idx), 0, pool->sizes[c]);
+    }
+    return idx;
+}
+
+uint32_t remove(Pool* pool, uint32_t index)
+{
+    assert(index < pool->count);
+    const auto last = --pool->count;
+    if (index != last) {
+        for (uint32_t c = 0; c < pool->num_components; ++c) {
+            std::memcpy(get_element(pool, c, index), get_element(pool, c, last), pool->sizes[c]);
+        }
+    }
+    return last;
+}
+
+void* get_component(Pool* pool, uint32_t component)
+{
+    assert(component < pool->num_components);
+    return get_element(pool, component, 0);
+}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fixed capacity structure-of-arrays pools. The header and all component arrays are in a single
+// allocation, so a pool can live in tracked memory and is restored with the snapshots as a whole.
+// Elements are kept densely packed: removing one moves the last element into its place.
+namespace pool {
+constexpr uint32_t MaxComponents = 16;
+// Every component array starts on its own cache line
+constexpr size_t Alignment = 64;
+
+struct Pool {
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t num_components;
+    uint32_t sizes[MaxComponents]; // of a single element
+    uint32_t offsets[MaxComponents]; // from the start of the pool
+};
+
+// The size of the memory that needs to be passed to init
+size_t get_size(uint32_t capacity, const uint32_t* sizes, uint32_t num_components);
+// `memory` needs to be aligned to Alignment and zeroed
+Pool* init(void* memory, uint32_t capacity, const uint32_t* sizes, uint32_t num_components);
+// Returns the index of the new element (zeroed). The pool must not be full.
+uint32_t add(Pool* pool);
+// Moves the last element into `index` and returns the index it was moved from (the new count).
+uint32_t remove(Pool* pool, uint32_t index);
+void* get_component(Pool* pool, uint32_t component);
+}
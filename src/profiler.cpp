@@ -0,0 +1,218 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <unordered_map>
+
+#include <sys/time.h>
+#include <ucontext.h>
+
+#include "gamecode.hpp"
+
+constexpr size_t MaxStackDepth = 32;
+constexpr size_t MaxNumSamples = 4096;
+constexpr uintptr_t MaxStackSize = 8 * 1024 * 1024;
+
+struct Sample {
+    uint32_t depth;
+    std::array<uintptr_t, MaxStackDepth> frames; // innermost first
+};
+
+// Written by the signal handler, on the main thread and on job workers. It only records samples
+// while game code runs and collect is only called outside of update/render, so they never access
+// these at the same time.
+std::array<Sample, MaxNumSamples> samples;
+// Handlers on different threads reserve slots with this. It keeps counting when samples is full,
+// so new samples are dropped if collect is not called in time.
+std::atomic<uint32_t> num_samples = 0;
+static_assert(std::atomic<uint32_t>::is_always_lock_free); // needed in a signal handler
+
+struct Profile {
+    bool enabled = false;
+    uint32_t num_samples = 0;
+    std::vector<profiler::HotSpot> hot_spots;
+    profiler::Node call_tree;
+    std::unordered_map<uintptr_t, gamecode::SourceLocation> locations;
+
+    static Profile& instance()
+    {
+        static Profile profile;
+        return profile;
+    }
+};
+
+static void get_registers(const void* uctx, uintptr_t& pc, uintptr_t& sp, uintptr_t& fp)
+{
+    [[maybe_unused]] const auto uc = static_cast<const ucontext_t*>(uctx);
+#if defined(__linux__) && defined(__x86_64__)
+    pc = static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RIP]);
+    sp = static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RSP]);
+    fp = static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RBP]);
+#elif defined(__linux__) && defined(__aarch64__)
+    pc = static_cast<uintptr_t>(uc->uc_mcontext.pc);
+    sp = static_cast<uintptr_t>(uc->uc_mcontext.sp);
+    fp = static_cast<uintptr_t>(uc->uc_mcontext.regs[29]);
+#else
+    pc = sp = fp = 0;
+#endif
+}
+
+// tcc always sets up a frame pointer and the engine is built with them too (see CMakeLists.txt),
+// so the frame pointer chain leads from engine code back into the game code that called it. Only
+// the game code frames are recorded, plus the PC, which might be in engine code.
+// Code without frame pointers (e.g. in libc) leaves the frame pointer of its caller, so at worst
+// the direct caller of such a function is missing.
+static void profile_handler(int, siginfo_t*, void* uctx)
+{
+    // This is per thread and only set while the thread runs game code
+    const auto stack_top = gamecode::get_callback_stack_top();
+    if (!stack_top) {
+        return;
+    }
+    uintptr_t pc, sp, fp;
+    get_registers(uctx, pc, sp, fp);
+    if (sp > stack_top || stack_top - sp > MaxStackSize) {
+        return;
+    }
+    const auto idx = num_samples.fetch_add(1, std::memory_order_relaxed);
+    if (idx >= samples.size()) {
+        return;
+    }
+    auto& sample = samples[idx];
+
+    sample.depth = 0;
+    sample.frames[sample.depth++] = pc;
+    bool in_game_code = gamecode::is_game_code(pc);
+    // Also bounds the engine frames that are skipped, in case the chain is garbage
+    for (size_t steps = 0; steps < 2 * MaxStackDepth && sample.depth < MaxStackDepth; ++steps) {
+        if (fp < sp || fp >= stack_top || fp % alignof(uintptr_t) != 0) {
+            break;
+        }
+        const auto frame = reinterpret_cast<const uintptr_t*>(fp);
+        const auto ret = frame[1];
+        if (gamecode::is_game_code(ret)) {
+            sample.frames[sample.depth++] = ret;
+            in_game_code = true;
+        } else if (in_game_code) {
+            break; // back in the engine code that called update/render (or the job)
+        }
+        if (frame[0] <= fp) {
+            break;
+        }
+        fp = frame[0];
+    }
+}
+
+static const gamecode::SourceLocation& get_location(uintptr_t address)
+{
+    auto& locations = Profile::instance().locations;
+    const auto it = locations.find(address);
+    if (it != locations.end()) {
+        return it->second;
+    }
+    return locations.emplace(address, gamecode::lookup(address)).first->second;
+}
+
+namespace profiler {
+void set_enabled(bool enabled)
+{
+    auto& prof = Profile::instance();
+    if (prof.enabled == enabled) {
+        return;
+    }
+    prof.enabled = enabled;
+
+    if (enabled) {
+        struct sigaction sa = {};
+        sa.sa_sigaction = profile_handler;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGPROF, &sa, nullptr);
+    }
+
+    itimerval timer = {};
+    if (enabled) {
+        timer.it_interval.tv_usec = 1000;
+        timer.it_value.tv_usec = 1000;
+    }
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+bool is_enabled()
+{
+    return Profile::instance().enabled;
+}
+
+void reset()
+{
+    auto& prof = Profile::instance();
+    prof.num_samples = 0;
+    prof.hot_spots.clear();
+    prof.call_tree = Node {};
+    // Addresses may have been reused by new game code
+    prof.locations.clear();
+    num_samples.store(0);
+}
+
+void collect()
+{
+    auto& prof = Profile::instance();
+    const auto count = std::min(static_cast<size_t>(num_samples.load()), samples.size());
+    if (count == 0) {
+        return;
+    }
+
+    for (size_t s = 0; s < count; ++s) {
+        const auto& sample = samples[s];
+
+        // The innermost frame is where the time is spent
+        const auto& loc = get_location(sample.frames[0]);
+        const auto hot_spot = std::find_if(
+            prof.hot_spots.begin(), prof.hot_spots.end(), [&loc](const HotSpot& hs) {
+                return hs.function == loc.function && hs.file == loc.file && hs.line == loc.line;
+            });
+        if (hot_spot != prof.hot_spots.end()) {
+            hot_spot->samples++;
+        } else {
+            prof.hot_spots.push_back(HotSpot { loc.function, loc.file, loc.line, 1 });
+        }
+
+        auto node = &prof.call_tree;
+        node->samples++;
+        for (size_t f = sample.depth; f-- > 0;) {
+            const auto function = get_location(sample.frames[f]).function;
+            auto child = std::find_if(node->children.begin(), node->children.end(),
+                [function](const Node& n) { return n.function == function; });
+            if (child == node->children.end()) {
+                node->children.push_back(Node { function, 0, {} });
+                child = std::prev(node->children.end());
+            }
+            child->samples++;
+            node = &*child;
+        }
+    }
+    prof.num_samples += static_cast<uint32_t>(count);
+    std::stable_sort(prof.hot_spots.begin(), prof.hot_spots.end(),
+        [](const HotSpot& a, const HotSpot& b) { return a.samples > b.samples; });
+
+    num_samples.store(0);
+}
+
+uint32_t get_num_samples()
+{
+    return Profile::instance().num_samples;
+}
+
+const std::vector<HotSpot>& get_hot_spots()
+{
+    return Profile::instance().hot_spots;
+}
+
+const Node& get_call_tree()
+{
+    return Profile::instance().call_tree;
+}
+}
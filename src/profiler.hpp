@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// A sampling profiler for game code. While enabled, SIGPROF interrupts the process every
+// millisecond of CPU time and if it lands in a thread that runs game code (in update/render or in
+// an ng_parallel_for job), the game code call stack is recorded.
+namespace profiler {
+struct HotSpot {
+    const char* function; // nullptr for samples in engine code
+    const char* file;
+    int line;
+    uint32_t samples;
+};
+
+// For the flame view. The root node has no function.
+struct Node {
+    const char* function = nullptr;
+    uint32_t samples = 0;
+    std::vector<Node> children;
+};
+
+void set_enabled(bool enabled);
+bool is_enabled();
+void reset();
+
+// Processes the recorded samples. Do not call this from an update/render callback.
+void collect();
+
+uint32_t get_num_samples();
+const std::vector<HotSpot>& get_hot_spots(); // sorted by samples (descending)
+const Node& get_call_tree();
+}
@@ -1,7 +1,13 @@
 #include "random.hpp"
 
+#include <bit>
 #include <random>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define RANDOM_SSE2
+#endif
+
 namespace rng {
 
 void init_state(RandomState* state)
@@ -10,6 +16,11 @@ void init_state(RandomState* state)
     state->state = rd();
 }
 
+void init_state(RandomState* state, uint64_t seed)
+{
+    state->state = seed;
+}
+
 RandomState* get_global_state()
 {
     static RandomState state;
@@ -35,25 +46,35 @@ RandomState* get_global_state()
  * I chose splitmix because the implementation is very short and only has 64-bit state.
  */
 // clang-format on
-uint64_t random(RandomState* state)
+constexpr uint64_t Gamma = 0x9e3779b97f4a7c15ull;
+
+static uint64_t mix(uint64_t z)
 {
-    uint64_t z = (state->state += 0x9e3779b97f4a7c15ull);
     z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
     z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
     return z ^ (z >> 31);
 }
 
+uint64_t random(RandomState* state)
+{
+    return mix(state->state += Gamma);
+}
+
 // I only do this because it's much better than float(rand())/max and it's easy to do
 // You essentially fix the exponent to 2^0 (0x7f << 23) and then fill up the mantissa with
 // some of the bits of the random number.
 // The result is between [1, 2], so you have to subtract one.
-float randomf(RandomState* state)
+static float to_float(uint64_t r)
 {
-    const auto r = random(state);
     const uint32_t bits = (0x7ful << 23) | static_cast<uint32_t>(r >> (32 + 9));
     return std::bit_cast<float>(bits) - 1.0f;
 }
 
+float randomf(RandomState* state)
+{
+    return to_float(random(state));
+}
+
 // This is probably not great, but doing a generic version of the function above is troublesome
 float randomf(float min, float max, RandomState* state)
 {
@@ -72,4 +93,75 @@ double randomd(double min, double max, RandomState* state)
     return min + randomd(state) * (max - min);
 }
 
+Stream make_stream(uint64_t seed, uint64_t id)
+{
+    // Mixing both makes keys of neighboring ids (and seeds) unrelated
+    return Stream { mix(mix(seed) ^ (id + Gamma)), 0 };
+}
+
+uint64_t random_at(uint64_t key, uint64_t counter)
+{
+    // The same as a RandomState starting at `key` after `counter + 1` calls
+    return mix(key + (counter + 1) * Gamma);
+}
+
+uint64_t random(Stream* stream)
+{
+    return random_at(stream->key, stream->counter++);
+}
+
+float randomf(Stream* stream)
+{
+    return to_float(random(stream));
+}
+
+#ifdef RANDOM_SSE2
+// SSE2 has no 64-bit multiply, so it's put together from 32x32->64 bit multiplies (mod 2^64)
+static __m128i mul64(__m128i a, uint64_t b)
+{
+    const auto b_lo = _mm_set1_epi64x(static_cast<int64_t>(b & 0xffffffffull));
+    const auto b_hi = _mm_set1_epi64x(static_cast<int64_t>(b >> 32));
+    const auto lo = _mm_mul_epu32(a, b_lo);
+    const auto cross
+        = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b_lo), _mm_mul_epu32(a, b_hi));
+    return _mm_add_epi64(lo, _mm_slli_epi64(cross, 32));
+}
+
+static __m128i mix(__m128i z)
+{
+    z = mul64(_mm_xor_si128(z, _mm_srli_epi64(z, 30)), 0xbf58476d1ce4e5b9ull);
+    z = mul64(_mm_xor_si128(z, _mm_srli_epi64(z, 27)), 0x94d049bb133111ebull);
+    return _mm_xor_si128(z, _mm_srli_epi64(z, 31));
+}
+#endif
+
+void fill(Stream* stream, float* out, size_t count)
+{
+    size_t i = 0;
+#ifdef RANDOM_SSE2
+    const auto c = stream->counter;
+    // z = key + (counter + 1) * Gamma for four consecutive counters, two per register
+    auto z0 = _mm_set_epi64x(static_cast<int64_t>(stream->key + (c + 2) * Gamma),
+        static_cast<int64_t>(stream->key + (c + 1) * Gamma));
+    auto z1 = _mm_add_epi64(z0, _mm_set1_epi64x(static_cast<int64_t>(2 * Gamma)));
+    const auto step = _mm_set1_epi64x(static_cast<int64_t>(4 * Gamma));
+    const auto one_bits = _mm_set1_epi32(0x7f << 23);
+    const auto one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4) {
+        // Same as to_float: the top 23 bits of each value go into the low 32 bits of its lane
+        const auto m0 = _mm_castsi128_ps(_mm_srli_epi64(mix(z0), 32 + 9));
+        const auto m1 = _mm_castsi128_ps(_mm_srli_epi64(mix(z1), 32 + 9));
+        const auto mantissa = _mm_castps_si128(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(2, 0, 2, 0)));
+        const auto f = _mm_castsi128_ps(_mm_or_si128(mantissa, one_bits));
+        _mm_storeu_ps(out + i, _mm_sub_ps(f, one));
+        z0 = _mm_add_epi64(z0, step);
+        z1 = _mm_add_epi64(z1, step);
+    }
+    stream->counter += i;
+#endif
+    for (; i < count; ++i) {
+        out[i] = randomf(stream);
+    }
+}
+
 }
@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <concepts>
+#include <cstddef>
 #include <cstdint>
 #include <limits>
 
@@ -17,7 +18,9 @@ struct RandomState {
 
 RandomState* get_global_state();
 
+// Seeds from std::random_device
 void init_state(RandomState* state);
+void init_state(RandomState* state, uint64_t seed);
 
 uint64_t random(RandomState* state = get_global_state());
 
@@ -49,4 +52,21 @@ float randomf(float min, float max, RandomState* state = get_global_state());
 double randomd(RandomState* state = get_global_state());
 double randomd(double min, double max, RandomState* state = get_global_state());
 
+// Counter-based streams: the n-th value of a stream only depends on (key, n), so streams don't
+// influence each other and drawing from one never shifts the values of another.
+// It's SplitMix64 again, just with the state computed from the counter instead of carried along.
+struct Stream {
+    uint64_t key;
+    uint64_t counter; // number of values drawn so far
+};
+
+Stream make_stream(uint64_t seed, uint64_t id);
+// Does not advance anything
+uint64_t random_at(uint64_t key, uint64_t counter);
+
+uint64_t random(Stream* stream);
+float randomf(Stream* stream);
+// Same as calling randomf(stream) `count` times, but vectorized
+void fill(Stream* stream, float* out, size_t count);
+
 }
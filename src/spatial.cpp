@@ -0,0 +1,150 @@
+#include "spatial.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+struct Entry {
+    float x;
+    float y;
+    int32_t cx;
+    int32_t cy;
+    uint32_t id;
+};
+
+// Entries are inserted unsorted and sorted into buckets (by cell hash) with a counting sort before
+// the first query after an insert, so all entries of a cell are contiguous in memory.
+struct Grid {
+    float cell_size = 64.0f;
+    std::vector<Entry> entries;
+    std::vector<Entry> sorted;
+    std::vector<uint32_t> bucket_start; // num buckets + 1
+    bool dirty = true; // so a query before the first insert builds an empty grid
+
+    static Grid& instance()
+    {
+        static Grid grid;
+        return grid;
+    }
+};
+
+// Cells are clamped, so far away positions (and inf or NaN) still get a valid cell and spans of
+// cells fit into an int64_t. Everything past the limit shares the edge cells, which only makes
+// queries there slower.
+static int32_t to_cell(float v, float cell_size)
+{
+    constexpr float Limit = 1 << 30;
+    const auto c = std::floor(v / cell_size);
+    if (!(c > -Limit)) { // also NaN
+        return -static_cast<int32_t>(Limit);
+    }
+    return static_cast<int32_t>(std::min(c, Limit));
+}
+
+static size_t get_bucket(int32_t cx, int32_t cy, size_t num_buckets)
+{
+    const auto hx = static_cast<uint32_t>(cx) * 73856093u;
+    const auto hy = static_cast<uint32_t>(cy) * 19349663u;
+    return (hx ^ hy) & (num_buckets - 1);
+}
+
+static void build(Grid& grid)
+{
+    size_t num_buckets = 64;
+    while (num_buckets < grid.entries.size() * 2) {
+        num_buckets *= 2;
+    }
+    grid.bucket_start.assign(num_buckets + 1, 0);
+    for (const auto& e : grid.entries) {
+        grid.bucket_start[get_bucket(e.cx, e.cy, num_buckets) + 1]++;
+    }
+    for (size_t b = 0; b < num_buckets; ++b) {
+        grid.bucket_start[b + 1] += grid.bucket_start[b];
+    }
+    grid.sorted.resize(grid.entries.size());
+    // This is stable, so the query results are in insertion order within a cell
+    std::vector<uint32_t> next(grid.bucket_start.begin(), grid.bucket_start.end() - 1);
+    for (const auto& e : grid.entries) {
+        grid.sorted[next[get_bucket(e.cx, e.cy, num_buckets)]++] = e;
+    }
+    grid.dirty = false;
+}
+
+namespace spatial {
+void clear(float cell_size)
+{
+    assert(cell_size > 0.0f);
+    auto& grid = Grid::instance();
+    grid.cell_size = cell_size;
+    grid.entries.clear();
+    grid.dirty = true;
+}
+
+void insert(uint32_t id, float x, float y)
+{
+    auto& grid = Grid::instance();
+    grid.entries.push_back(
+        Entry { x, y, to_cell(x, grid.cell_size), to_cell(y, grid.cell_size), id });
+    grid.dirty = true;
+}
+
+void build()
+{
+    auto& grid = Grid::instance();
+    if (grid.dirty) {
+        build(grid);
+    }
+}
+
+size_t query_radius(float x, float y, float radius, uint32_t* out, size_t capacity)
+{
+    auto& grid = Grid::instance();
+    if (grid.dirty) {
+        build(grid);
+    }
+
+    const auto r2 = radius * radius;
+    size_t count = 0;
+    const auto check = [&](const Entry& e) {
+        const auto dx = e.x - x;
+        const auto dy = e.y - y;
+        if (dx * dx + dy * dy <= r2) {
+            if (count < capacity) {
+                out[count] = e.id;
+            }
+            count++;
+        }
+    };
+
+    const auto min_cx = to_cell(x - radius, grid.cell_size);
+    const auto max_cx = to_cell(x + radius, grid.cell_size);
+    const auto min_cy = to_cell(y - radius, grid.cell_size);
+    const auto max_cy = to_cell(y + radius, grid.cell_size);
+    const auto num_cells = (static_cast<int64_t>(max_cx) - min_cx + 1)
+        * (static_cast<int64_t>(max_cy) - min_cy + 1);
+    const auto num_buckets = grid.bucket_start.size() - 1;
+
+    if (num_cells > static_cast<int64_t>(num_buckets)) {
+        // The query covers more cells than there are buckets, so just check everything
+        for (const auto& e : grid.sorted) {
+            check(e);
+        }
+        return count;
+    }
+
+    for (auto cy = min_cy; cy <= max_cy; ++cy) {
+        for (auto cx = min_cx; cx <= max_cx; ++cx) {
+            const auto bucket = get_bucket(cx, cy, num_buckets);
+            for (auto i = grid.bucket_start[bucket]; i < grid.bucket_start[bucket + 1]; ++i) {
+                const auto& e = grid.sorted[i];
+                // Multiple cells might end up in the same bucket
+                if (e.cx == cx && e.cy == cy) {
+                    check(e);
+                }
+            }
+        }
+    }
+    return count;
+}
+}
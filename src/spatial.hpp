@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A uniform grid for neighbor queries. It is not part of the snapshots, so it should be rebuilt
+// (clear + insert) in the same update/render call it is queried in.
+namespace spatial {
+// Removes all entries. `cell_size` should be about the size of a typical query radius and must be
+// positive and finite.
+void clear(float cell_size);
+void insert(uint32_t id, float x, float y);
+// Sorts the inserted entries. This is done by the first query after an insert anyway, but after
+// this call queries don't modify anything and can be made from multiple threads.
+void build();
+// Writes the ids of all entries within `radius` of (x, y) to `out` (at most `capacity`) and
+// returns the number of entries found, which might be larger than `capacity`.
+// The order is deterministic for the same sequence of inserts. `radius` must not be negative.
+size_t query_radius(float x, float y, float radius, uint32_t* out, size_t capacity);
+}
@@ -0,0 +1,317 @@
+#include "text.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "atlas.hpp"
+#include "gfx.hpp"
+#include "image.hpp"
+
+// imgui_draw.cpp has its own static copy, so this does not collide
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+// It's not written for our warnings
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wconversion"
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include "imstb_truetype.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+// Empty space around every glyph in its cell, so filtering does not bleed neighbors into it
+constexpr uint32_t Padding = 1;
+// The cache texture fits this many cells squared, unless that's larger than MaxCacheSize
+constexpr uint32_t CacheCells = 16;
+constexpr uint32_t MaxCacheSize = atlas::PageSize / 2; // so large fonts leave room for images
+
+struct Glyph {
+    uint32_t codepoint = 0;
+    bool used = false; // whether the cell holds a glyph
+    uint64_t last_drawn = 0; // gfx::get_frame()
+    // The rasterized part, relative to the pen position on the baseline
+    float x0 = 0.0f, y0 = 0.0f, x1 = 0.0f, y1 = 0.0f;
+    float advance = 0.0f;
+};
+
+struct Font {
+    std::string path;
+    float size = 0.0f;
+    std::vector<uint8_t> data; // stbtt_fontinfo points into it
+    stbtt_fontinfo info = {};
+    float scale = 0.0f;
+    float ascent = 0.0f;
+    float line_height = 0.0f;
+    uint32_t cell_size = 0;
+    uint32_t cells_per_row = 0;
+    uint32_t cache_size = 0; // the cache texture is this size squared
+    gfx::Texture* cache = nullptr; // created when the first glyph is drawn
+    gfx::TextureInfo cache_info = {};
+    std::vector<Glyph> cells;
+    std::unordered_map<uint32_t, uint32_t> lookup; // codepoint -> cell
+};
+
+struct Text {
+    std::vector<std::unique_ptr<Font>> fonts;
+    std::vector<gfx::Quad> quads;
+    image::Image bitmap; // one cell, to upload glyphs
+    std::vector<uint8_t> coverage;
+
+    static Text& instance()
+    {
+        static Text text;
+        return text;
+    }
+};
+
+// Invalid sequences are decoded as U+FFFD one byte at a time
+static uint32_t decode_utf8(std::string_view str, size_t* pos)
+{
+    constexpr uint32_t Replacement = 0xfffd;
+    const auto c = static_cast<uint8_t>(str[(*pos)++]);
+    if (c < 0x80) {
+        return c;
+    }
+    size_t len = 0;
+    uint32_t cp = 0;
+    if ((c & 0xe0) == 0xc0) {
+        len = 1;
+        cp = c & 0x1f;
+    } else if ((c & 0xf0) == 0xe0) {
+        len = 2;
+        cp = c & 0x0f;
+    } else if ((c & 0xf8) == 0xf0) {
+        len = 3;
+        cp = c & 0x07;
+    } else {
+        return Replacement;
+    }
+    if (*pos + len > str.size()) {
+        return Replacement;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        const auto b = static_cast<uint8_t>(str[*pos + i]);
+        if ((b & 0xc0) != 0x80) {
+            return Replacement;
+        }
+        cp = cp << 6 | (b & 0x3f);
+    }
+    *pos += len;
+    return cp;
+}
+
+// Returns the cell of the glyph, rasterizing it if needed, or nullptr if every cell was already
+// used in the current frame
+static const Glyph* get_glyph(Text& text, Font& font, uint32_t codepoint)
+{
+    const auto frame = gfx::get_frame();
+    if (const auto it = font.lookup.find(codepoint); it != font.lookup.end()) {
+        auto& glyph = font.cells[it->second];
+        glyph.last_drawn = frame;
+        return &glyph;
+    }
+
+    // Take an empty cell or evict the least recently drawn glyph. Misses are rare once the text on
+    // screen is cached, so the linear search is fine.
+    const auto it = std::min_element(font.cells.begin(), font.cells.end(),
+        [](const Glyph& a, const Glyph& b) {
+            return std::tie(a.used, a.last_drawn) < std::tie(b.used, b.last_drawn);
+        });
+    if (it->used && it->last_drawn == frame) {
+        // The upload is only done at the next flush, so it would also change the quads that were
+        // queued (or recorded into the draw list of the frame) before
+        return nullptr;
+    }
+    const auto cell = static_cast<uint32_t>(it - font.cells.begin());
+    auto& glyph = *it;
+    if (glyph.used) {
+        font.lookup.erase(glyph.codepoint);
+    }
+
+    const auto index = stbtt_FindGlyphIndex(&font.info, static_cast<int>(codepoint));
+    int advance = 0;
+    stbtt_GetGlyphHMetrics(&font.info, index, &advance, nullptr);
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    stbtt_GetGlyphBitmapBox(&font.info, index, font.scale, font.scale, &x0, &y0, &x1, &y1);
+    // Glyphs that are larger than a cell are cut off
+    const auto max_size = static_cast<int>(font.cell_size - 2 * Padding);
+    const auto width = std::min(x1 - x0, max_size);
+    const auto height = std::min(y1 - y0, max_size);
+
+    // White with the coverage as alpha, the color comes from the quads
+    const auto cell_size = font.cell_size;
+    text.coverage.assign(static_cast<size_t>(max_size) * static_cast<size_t>(max_size), 0);
+    if (width > 0 && height > 0) {
+        stbtt_MakeGlyphBitmap(&font.info, text.coverage.data(), width, height, max_size,
+            font.scale, font.scale, index);
+    }
+    if (text.bitmap.width != cell_size) {
+        text.bitmap.width = cell_size;
+        text.bitmap.height = cell_size;
+        text.bitmap.pixels = std::make_unique<uint8_t[]>(cell_size * cell_size * 4);
+    }
+    std::fill_n(text.bitmap.pixels.get(), cell_size * cell_size * 4, 0);
+    for (uint32_t y = 0; y < static_cast<uint32_t>(std::max(height, 0)); ++y) {
+        for (uint32_t x = 0; x < static_cast<uint32_t>(std::max(width, 0)); ++x) {
+            auto px = &text.bitmap.pixels[((y + Padding) * cell_size + x + Padding) * 4];
+            px[0] = px[1] = px[2] = 255;
+            px[3] = text.coverage[y * static_cast<uint32_t>(max_size) + x];
+        }
+    }
+    const auto cell_x = cell % font.cells_per_row * cell_size;
+    const auto cell_y = cell / font.cells_per_row * cell_size;
+    gfx::update_texture(font.cache, cell_x, cell_y, text.bitmap);
+
+    glyph.codepoint = codepoint;
+    glyph.used = true;
+    glyph.last_drawn = frame;
+    glyph.x0 = static_cast<float>(x0);
+    glyph.y0 = static_cast<float>(y0);
+    glyph.x1 = static_cast<float>(x0 + std::max(width, 0));
+    glyph.y1 = static_cast<float>(y0 + std::max(height, 0));
+    glyph.advance = static_cast<float>(advance) * font.scale;
+    font.lookup.emplace(codepoint, cell);
+    return &glyph;
+}
+
+static Font& get_font(uint32_t font)
+{
+    auto& text = Text::instance();
+    assert(font != 0 && font <= text.fonts.size());
+    return *text.fonts[font - 1];
+}
+
+namespace text {
+std::optional<uint32_t> load_font(std::string_view path, float size)
+{
+    auto& text = Text::instance();
+    assert(size > 0.0f && size <= MaxFontSize);
+    for (size_t i = 0; i < text.fonts.size(); ++i) {
+        if (text.fonts[i]->path == path && text.fonts[i]->size == size) {
+            return static_cast<uint32_t>(i + 1);
+        }
+    }
+    assert(text.fonts.size() < MaxNumFonts);
+
+    auto data = image::read_file(path);
+    if (!data) {
+        return std::nullopt;
+    }
+    auto font = std::make_unique<Font>();
+    font->path = path;
+    font->size = size;
+    font->data = std::move(*data);
+    const auto offset = stbtt_GetFontOffsetForIndex(font->data.data(), 0);
+    if (offset < 0 || !stbtt_InitFont(&font->info, font->data.data(), offset)) {
+        fmt::println("'{}' is not a TrueType font", path);
+        return std::nullopt;
+    }
+    font->scale = stbtt_ScaleForPixelHeight(&font->info, size);
+    int ascent = 0, descent = 0, line_gap = 0;
+    stbtt_GetFontVMetrics(&font->info, &ascent, &descent, &line_gap);
+    font->ascent = static_cast<float>(ascent) * font->scale;
+    font->line_height = static_cast<float>(ascent - descent + line_gap) * font->scale;
+    font->cell_size = static_cast<uint32_t>(std::ceil(size)) + 2 * Padding;
+    font->cache_size = std::min(CacheCells * font->cell_size, MaxCacheSize);
+    font->cells_per_row = font->cache_size / font->cell_size;
+    font->cells.resize(font->cells_per_row * font->cells_per_row);
+    text.fonts.push_back(std::move(font));
+    return static_cast<uint32_t>(text.fonts.size());
+}
+
+size_t get_num_fonts()
+{
+    return Text::instance().fonts.size();
+}
+
+void draw(uint32_t font_handle, std::string_view str, float x, float y, float r, float g, float b,
+    float a)
+{
+    auto& text = Text::instance();
+    auto& font = get_font(font_handle);
+    if (!font.cache) {
+        font.cache = gfx::create_empty_texture(font.cache_size, font.cache_size);
+        if (!font.cache) {
+            return; // the atlas is full, create_empty_texture said so
+        }
+        font.cache_info = gfx::get_texture_info(font.cache);
+    }
+
+    const auto& info = font.cache_info;
+    const auto du = (info.u1 - info.u0) / static_cast<float>(info.width);
+    const auto dv = (info.v1 - info.v0) / static_cast<float>(info.height);
+    // Glyphs are placed on whole pixels, so they stay sharp
+    const auto left = std::round(x);
+    auto pen_x = left;
+    auto baseline = std::round(y + font.ascent);
+    auto min_x = pen_x, max_x = pen_x;
+    text.quads.clear();
+    size_t pos = 0;
+    while (pos < str.size()) {
+        const auto codepoint = decode_utf8(str, &pos);
+        if (codepoint == '\n') {
+            pen_x = left;
+            baseline += std::round(font.line_height);
+            continue;
+        }
+        const auto glyph = get_glyph(text, font, codepoint);
+        if (!glyph) {
+            // Not drawn, but the text after it stays where it belongs
+            int advance = 0;
+            stbtt_GetCodepointHMetrics(&font.info, static_cast<int>(codepoint), &advance, nullptr);
+            pen_x += static_cast<float>(advance) * font.scale;
+            continue;
+        }
+        if (glyph->x1 > glyph->x0) {
+            const auto cell = static_cast<uint32_t>(glyph - font.cells.data());
+            const auto u = static_cast<float>(cell % font.cells_per_row * font.cell_size + Padding);
+            const auto v = static_cast<float>(cell / font.cells_per_row * font.cell_size + Padding);
+            const auto px = std::round(pen_x);
+            text.quads.push_back(gfx::Quad { px + glyph->x0, baseline + glyph->y0,
+                px + glyph->x1, baseline + glyph->y1, info.u0 + u * du, info.v0 + v * dv,
+                info.u0 + (u + glyph->x1 - glyph->x0) * du,
+                info.v0 + (v + glyph->y1 - glyph->y0) * dv, r, g, b, a });
+            min_x = std::min(min_x, px + glyph->x0);
+            max_x = std::max(max_x, px + glyph->x1);
+        }
+        pen_x += glyph->advance;
+    }
+
+    const auto top = std::round(y);
+    if (a > 0.0f && gfx::is_visible(min_x, top, max_x, baseline + font.line_height)) {
+        gfx::draw_quads(info.page, text.quads, 0.0f, 0.0f);
+    }
+}
+
+float measure(uint32_t font_handle, std::string_view str)
+{
+    auto& font = get_font(font_handle);
+    float width = 0.0f;
+    float line_width = 0.0f;
+    size_t pos = 0;
+    while (pos < str.size()) {
+        const auto codepoint = decode_utf8(str, &pos);
+        if (codepoint == '\n') {
+            line_width = 0.0f;
+            continue;
+        }
+        // This does not need the glyph to be rasterized
+        int advance = 0;
+        stbtt_GetCodepointHMetrics(&font.info, static_cast<int>(codepoint), &advance, nullptr);
+        line_width += static_cast<float>(advance) * font.scale;
+        width = std::max(width, line_width);
+    }
+    return width;
+}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Text drawn through the sprite queue. Glyphs are rasterized when they are first drawn into a
+// cache texture per font, which is split into equally sized cells. When all cells are taken, the
+// glyph that was drawn least recently is replaced. Glyphs that do not fit, because every cell was
+// used in the current frame, are left out.
+namespace text {
+constexpr float MaxFontSize = 128.0f;
+constexpr size_t MaxNumFonts = 16;
+
+// size is the height of a line in pixels. Loading the same file with the same size again returns
+// the same handle. Returns nullopt if the file can not be read or is not a TrueType font.
+std::optional<uint32_t> load_font(std::string_view path, float size);
+size_t get_num_fonts();
+// (x, y) is the top left of the first line. Lines are separated by '\n', str is UTF-8.
+void draw(
+    uint32_t font, std::string_view str, float x, float y, float r, float g, float b, float a);
+// The width of the widest line in pixels
+float measure(uint32_t font, std::string_view str);
+}
@@ -0,0 +1,233 @@
+#include "thumbnails.hpp"
+
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "core.hpp"
+#include "drawlists.hpp"
+#include "gfx.hpp"
+
+// Draws into a SoftBackend at 1/scale of the size
+struct ScaledBackend : gfx::Backend {
+    gfx::SoftBackend soft;
+    uint32_t scale = thumbnails::Scale;
+    std::vector<gfx::Quad> scaled;
+
+    ScaledBackend(uint32_t width, uint32_t height)
+        : soft(width, height)
+    {
+    }
+
+    void begin_frame() override { soft.begin_frame(); }
+    void create_page(uint32_t page) override { soft.create_page(page); }
+    void upload(uint32_t page, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+        const uint8_t* pixels) override
+    {
+        soft.upload(page, x, y, width, height, pixels);
+    }
+    void draw(uint32_t page, const gfx::Quad* quads, size_t count) override
+    {
+        const auto s = 1.0f / static_cast<float>(scale);
+        scaled.assign(quads, quads + count);
+        for (auto& q : scaled) {
+            q.x0 *= s;
+            q.y0 *= s;
+            q.x1 *= s;
+            q.y1 *= s;
+        }
+        soft.draw(page, scaled.data(), scaled.size());
+    }
+    void end_frame() override { soft.end_frame(); }
+};
+
+struct Slot {
+    uint32_t frame = 0;
+    uint64_t stamp = 0; // of the draw list it was rendered from
+    uint64_t version = 0;
+    image::Image image;
+};
+
+struct Thumbnails {
+    std::unique_ptr<ScaledBackend> renderer;
+    std::array<Slot, thumbnails::MaxNumThumbnails> slots;
+    std::vector<uint32_t> free_slots;
+    std::map<uint32_t, uint32_t> frames; // frame -> slot
+    uint32_t interval = thumbnails::InitialInterval;
+    uint64_t next_version = 1;
+    std::vector<std::byte> commands;
+    // The last preview, drawn into instead of the renderer's framebuffer
+    image::Image preview;
+    uint32_t preview_frame = 0;
+    uint64_t preview_stamp = 0;
+
+    static Thumbnails& instance()
+    {
+        static Thumbnails thumbs;
+        return thumbs;
+    }
+};
+
+static thumbnails::Thumbnail make_thumbnail(const Thumbnails& thumbs, uint32_t frame, uint32_t slot)
+{
+    return thumbnails::Thumbnail { frame, slot, thumbs.slots[slot].version,
+        &thumbs.slots[slot].image };
+}
+
+// Draws the frame into the renderer's framebuffer at 1/scale of the size. Returns false if the
+// draw list can't be drawn anymore (the textures changed).
+static bool draw_frame(Thumbnails& thumbs, uint32_t frame, uint32_t scale)
+{
+    if (!drawlists::load(frame, gfx::get_texture_generation(), &thumbs.commands)) {
+        return false;
+    }
+    auto& renderer = *thumbs.renderer;
+    renderer.scale = scale;
+    renderer.begin_frame();
+    gfx::replay(thumbs.commands, &renderer);
+    renderer.end_frame();
+    return true;
+}
+
+static bool render(Thumbnails& thumbs, uint32_t frame, uint64_t stamp)
+{
+    if (!draw_frame(thumbs, frame, thumbnails::Scale)) {
+        return false;
+    }
+    auto& renderer = *thumbs.renderer;
+
+    auto it = thumbs.frames.find(frame);
+    if (it == thumbs.frames.end()) {
+        assert(!thumbs.free_slots.empty());
+        it = thumbs.frames.emplace(frame, thumbs.free_slots.back()).first;
+        thumbs.free_slots.pop_back();
+    }
+    auto& slot = thumbs.slots[it->second];
+    const auto& fb = renderer.soft.framebuffer;
+    const auto size = static_cast<size_t>(fb.width) * fb.height * 4;
+    if (!slot.image.pixels) {
+        slot.image.width = fb.width;
+        slot.image.height = fb.height;
+        slot.image.pixels = std::make_unique<uint8_t[]>(size);
+    }
+    std::memcpy(slot.image.pixels.get(), fb.pixels.get(), size);
+    slot.frame = frame;
+    slot.stamp = stamp;
+    slot.version = thumbs.next_version++;
+    return true;
+}
+
+namespace thumbnails {
+void init(uint32_t width, uint32_t height)
+{
+    auto& thumbs = Thumbnails::instance();
+    thumbs.renderer = std::make_unique<ScaledBackend>(width / Scale, height / Scale);
+    thumbs.preview.width = width / PreviewScale;
+    thumbs.preview.height = height / PreviewScale;
+    thumbs.preview.pixels = std::make_unique<uint8_t[]>(
+        static_cast<size_t>(thumbs.preview.width) * thumbs.preview.height * 4);
+    gfx::set_upload_mirror(thumbs.renderer.get());
+    for (size_t i = 0; i < MaxNumThumbnails; ++i) {
+        thumbs.free_slots.push_back(static_cast<uint32_t>(MaxNumThumbnails - 1 - i));
+    }
+}
+
+void update(uint32_t last_frame, float budget_ms)
+{
+    auto& thumbs = Thumbnails::instance();
+    if (!thumbs.renderer) {
+        return;
+    }
+
+    // Stay within the memory budget by thinning out the thumbnails we have
+    while (last_frame / thumbs.interval + 1 > MaxNumThumbnails) {
+        thumbs.interval *= 2;
+        for (auto it = thumbs.frames.begin(); it != thumbs.frames.end();) {
+            if (it->first % thumbs.interval != 0) {
+                thumbs.free_slots.push_back(it->second);
+                it = thumbs.frames.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    const auto start = platform::get_perf_counter();
+    auto frame = last_frame - last_frame % thumbs.interval;
+    while (true) {
+        const auto stamp = drawlists::get_stamp(frame);
+        const auto it = thumbs.frames.find(frame);
+        const auto outdated = it == thumbs.frames.end() || thumbs.slots[it->second].stamp != stamp;
+        if (stamp != 0 && outdated && render(thumbs, frame, stamp)
+            && platform::get_perf_counter_elapsed(start, 1000) > budget_ms) {
+            break;
+        }
+        if (frame < thumbs.interval) {
+            break;
+        }
+        frame -= thumbs.interval;
+    }
+}
+
+std::optional<Thumbnail> find(uint32_t frame)
+{
+    const auto& thumbs = Thumbnails::instance();
+    auto it = thumbs.frames.upper_bound(frame);
+    if (it == thumbs.frames.begin()) {
+        return std::nullopt;
+    }
+    --it;
+    return make_thumbnail(thumbs, it->first, it->second);
+}
+
+std::optional<Preview> get_preview(uint32_t frame)
+{
+    auto& thumbs = Thumbnails::instance();
+    if (!thumbs.renderer) {
+        return std::nullopt;
+    }
+    const auto stamp = drawlists::get_stamp(frame);
+    if (stamp == 0) {
+        return std::nullopt;
+    }
+    if (thumbs.preview_frame != frame || thumbs.preview_stamp != stamp) {
+        // Shares the atlas copies with the thumbnails, only the target is different
+        auto& fb = thumbs.renderer->soft.framebuffer;
+        std::swap(fb, thumbs.preview);
+        const auto drawn = draw_frame(thumbs, frame, PreviewScale);
+        std::swap(fb, thumbs.preview);
+        if (!drawn) {
+            return std::nullopt;
+        }
+        thumbs.preview_frame = frame;
+        thumbs.preview_stamp = stamp;
+    }
+    return Preview { frame, thumbs.preview_stamp, &thumbs.preview };
+}
+
+std::vector<Thumbnail> get_all()
+{
+    const auto& thumbs = Thumbnails::instance();
+    std::vector<Thumbnail> res;
+    res.reserve(thumbs.frames.size());
+    for (const auto& [frame, slot] : thumbs.frames) {
+        res.push_back(make_thumbnail(thumbs, frame, slot));
+    }
+    return res;
+}
+
+uint32_t get_width()
+{
+    const auto& thumbs = Thumbnails::instance();
+    return thumbs.renderer ? thumbs.renderer->soft.framebuffer.width : 0;
+}
+
+uint32_t get_height()
+{
+    const auto& thumbs = Thumbnails::instance();
+    return thumbs.renderer ? thumbs.renderer->soft.framebuffer.height : 0;
+}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "image.hpp"
+
+// Small pictures of every few frames, rendered on the CPU from the stored draw lists, for the
+// timeline in the debug UI.
+namespace thumbnails {
+constexpr uint32_t Scale = 8; // thumbnails are 1/Scale of the render target
+constexpr uint32_t PreviewScale = 4;
+// When there are more frames than fit, every other thumbnail is dropped and the interval doubles
+constexpr uint32_t InitialInterval = 10;
+constexpr size_t MaxNumThumbnails = 256;
+
+struct Thumbnail {
+    uint32_t frame;
+    uint32_t slot; // < MaxNumThumbnails, stays the same while the thumbnail exists
+    uint64_t version; // changes whenever the slot gets a new image
+    const image::Image* image;
+};
+
+struct Preview {
+    uint32_t frame;
+    uint64_t stamp; // of the draw list it was rendered from
+    const image::Image* image; // valid until the next get_preview
+};
+
+// Call before the first texture is created, because it keeps copies of the atlas pages
+void init(uint32_t width, uint32_t height);
+// Renders missing and outdated thumbnails, newest first, until budget_ms have passed
+void update(uint32_t last_frame, float budget_ms);
+// The thumbnail of the closest frame at or before `frame`
+std::optional<Thumbnail> find(uint32_t frame);
+// The frame drawn at 1/PreviewScale, e.g. to show a thumbnail bigger. It's only rendered again
+// when the frame or its draw list changes. nullopt if the frame can't be drawn.
+std::optional<Preview> get_preview(uint32_t frame);
+// In frame order
+std::vector<Thumbnail> get_all();
+uint32_t get_width();
+uint32_t get_height();
+}
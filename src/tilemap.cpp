@@ -0,0 +1,142 @@
+#include "tilemap.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+static uint64_t* get_stamps(tilemap::Tilemap* map)
+{
+    return reinterpret_cast<uint64_t*>(map + 1);
+}
+
+static const uint64_t* get_stamps(const tilemap::Tilemap* map)
+{
+    return reinterpret_cast<const uint64_t*>(map + 1);
+}
+
+static uint32_t* get_tiles(tilemap::Tilemap* map)
+{
+    return reinterpret_cast<uint32_t*>(get_stamps(map) + map->chunks_x * map->chunks_y);
+}
+
+static const uint32_t* get_tiles(const tilemap::Tilemap* map)
+{
+    return reinterpret_cast<const uint32_t*>(get_stamps(map) + map->chunks_x * map->chunks_y);
+}
+
+// What a tile adds to the stamp of its chunk (with xor), so the stamp can be updated without
+// looking at the other tiles. Empty tiles add nothing.
+static uint64_t tile_hash(uint32_t x, uint32_t y, uint32_t tile)
+{
+    if (tile == 0) {
+        return 0;
+    }
+    // The splitmix64 finalizer of the position in the chunk and the tile
+    const auto pos = (y % tilemap::ChunkSize) * tilemap::ChunkSize + x % tilemap::ChunkSize;
+    auto h = static_cast<uint64_t>(pos) << 32 | tile;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+static uint32_t num_chunks(uint32_t tiles)
+{
+    return (tiles + tilemap::ChunkSize - 1) / tilemap::ChunkSize;
+}
+
+namespace tilemap {
+static_assert(sizeof(Tilemap) % Alignment == 0);
+
+size_t get_size(uint32_t width, uint32_t height)
+{
+    const auto size = sizeof(Tilemap)
+        + static_cast<size_t>(num_chunks(width)) * num_chunks(height) * sizeof(uint64_t)
+        + static_cast<size_t>(width) * height * sizeof(uint32_t);
+    return (size + Alignment - 1) / Alignment * Alignment;
+}
+
+Tilemap* init(
+    void* memory, uint32_t image_handle, uint32_t tile_size, uint32_t width, uint32_t height)
+{
+    assert(reinterpret_cast<uintptr_t>(memory) % Alignment == 0);
+    auto map = static_cast<Tilemap*>(memory);
+    map->image_handle = image_handle;
+    map->tile_size = tile_size;
+    map->width = width;
+    map->height = height;
+    map->chunks_x = num_chunks(width);
+    map->chunks_y = num_chunks(height);
+    return map;
+}
+
+uint32_t get_num_chunks(const Tilemap* map)
+{
+    return map->chunks_x * map->chunks_y;
+}
+
+uint64_t get_stamp(const Tilemap* map, uint32_t chunk)
+{
+    assert(chunk < get_num_chunks(map));
+    return get_stamps(map)[chunk];
+}
+
+void set(Tilemap* map, uint32_t x, uint32_t y, uint32_t tile)
+{
+    assert(x < map->width && y < map->height);
+    auto& t = get_tiles(map)[y * map->width + x];
+    get_stamps(map)[(y / ChunkSize) * map->chunks_x + x / ChunkSize]
+        ^= tile_hash(x, y, t) ^ tile_hash(x, y, tile);
+    t = tile;
+}
+
+uint32_t get(const Tilemap* map, uint32_t x, uint32_t y)
+{
+    assert(x < map->width && y < map->height);
+    return get_tiles(map)[y * map->width + x];
+}
+
+gfx::Quad get_chunk_bounds(const Tilemap* map, uint32_t chunk)
+{
+    const auto size = static_cast<float>(ChunkSize * map->tile_size);
+    const auto x = static_cast<float>(chunk % map->chunks_x) * size;
+    const auto y = static_cast<float>(chunk / map->chunks_x) * size;
+    gfx::Quad q = {};
+    q.x0 = x;
+    q.y0 = y;
+    q.x1 = x + size;
+    q.y1 = y + size;
+    return q;
+}
+
+void build_chunk(const Tilemap* map, uint32_t chunk, const gfx::TextureInfo& tileset,
+    std::vector<gfx::Quad>* quads)
+{
+    quads->clear();
+    // While the tileset is loading, this is 0 and nothing is drawn
+    const auto columns = tileset.width / map->tile_size;
+    const auto num_tiles = columns * (tileset.height / map->tile_size);
+    const auto du = (tileset.u1 - tileset.u0) / static_cast<float>(tileset.width);
+    const auto dv = (tileset.v1 - tileset.v0) / static_cast<float>(tileset.height);
+    const auto tile_size = static_cast<float>(map->tile_size);
+
+    const auto x0 = (chunk % map->chunks_x) * ChunkSize;
+    const auto y0 = (chunk / map->chunks_x) * ChunkSize;
+    const auto x1 = std::min(x0 + ChunkSize, map->width);
+    const auto y1 = std::min(y0 + ChunkSize, map->height);
+    const auto tiles = get_tiles(map);
+    for (uint32_t y = y0; y < y1; ++y) {
+        for (uint32_t x = x0; x < x1; ++x) {
+            const auto tile = tiles[y * map->width + x];
+            if (tile == 0 || tile > num_tiles) {
+                continue;
+            }
+            const auto u = static_cast<float>((tile - 1) % columns * map->tile_size);
+            const auto v = static_cast<float>((tile - 1) / columns * map->tile_size);
+            const auto px = static_cast<float>(x) * tile_size;
+            const auto py = static_cast<float>(y) * tile_size;
+            quads->push_back(gfx::Quad { px, py, px + tile_size, py + tile_size,
+                tileset.u0 + u * du, tileset.v0 + v * dv, tileset.u0 + (u + tile_size) * du,
+                tileset.v0 + (v + tile_size) * dv, 1.0f, 1.0f, 1.0f, 1.0f });
+        }
+    }
+}
+}
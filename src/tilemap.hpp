@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gfx.hpp"
+
+// Grids of tiles from a tileset image. Like pools, a tilemap is a single allocation that lives in
+// tracked memory. The geometry is built per chunk outside of it (see build_chunk) and every chunk
+// has a stamp, a hash of its tiles that is updated on every change. It only depends on the tiles,
+// so replays produce the same bytes and cached geometry can be checked cheaply even after a
+// snapshot was restored.
+namespace tilemap {
+constexpr uint32_t ChunkSize = 16; // in tiles
+constexpr size_t Alignment = alignof(uint64_t);
+
+struct Tilemap {
+    uint32_t image_handle;
+    uint32_t tile_size; // in pixels
+    uint32_t width, height; // in tiles
+    uint32_t chunks_x, chunks_y;
+    // Followed by chunks_x * chunks_y stamps (uint64_t) and width * height tiles (uint32_t)
+};
+
+// The size of the memory that needs to be passed to init, a multiple of Alignment
+size_t get_size(uint32_t width, uint32_t height);
+// `memory` needs to be zeroed and aligned to Alignment
+Tilemap* init(
+    void* memory, uint32_t image_handle, uint32_t tile_size, uint32_t width, uint32_t height);
+uint32_t get_num_chunks(const Tilemap* map);
+// 0 if the chunk is empty
+uint64_t get_stamp(const Tilemap* map, uint32_t chunk);
+// Tiles are numbered row by row through the tileset, starting at 1. 0 is empty.
+void set(Tilemap* map, uint32_t x, uint32_t y, uint32_t tile);
+uint32_t get(const Tilemap* map, uint32_t x, uint32_t y);
+// The area covered by a chunk in pixels, relative to the top left of the map
+gfx::Quad get_chunk_bounds(const Tilemap* map, uint32_t chunk);
+// Replaces quads with one quad per non-empty tile in the chunk, relative to the top left of the
+// map. Tiles that are not in the tileset are skipped.
+void build_chunk(const Tilemap* map, uint32_t chunk, const gfx::TextureInfo& tileset,
+    std::vector<gfx::Quad>* quads);
+}
@@ -1,9 +1,13 @@
 #include "vm.hpp"
 
+#include <cstring>
 #include <string>
+#include <vector>
 
 #include <fmt/core.h>
 
+#include "drawlists.hpp"
+#include "engine.hpp"
 #include "fswatcher.hpp"
 #include "memtrack.hpp"
 
@@ -23,24 +27,61 @@ std::string_view Vm::to_string(Mode mode)
     }
 }
 
-static void reload_game_code(void* ctx, std::string_view path)
+static void collect_dependency(void* ctx, const char* path)
+{
+    static_cast<std::vector<std::string>*>(ctx)->emplace_back(path);
+}
+
+// This is called for the game source and all the headers it includes, so we always compile the
+// game source and not `path`.
+static void reload_game_code(void* ctx, std::string_view)
 {
     auto vm = (Vm*)ctx;
-    auto gc = gamecode::load(std::string(path).c_str());
+    const auto prev = vm->hot_most_recent.game_code;
+    std::vector<std::string> deps;
+    auto gc = gamecode::load(vm->game_source, prev, collect_dependency, &deps);
+    // Stop watching headers that are not included anymore. After a failed compile the old ones are
+    // kept, because the fix might be to include one of them again.
+    if (gc) {
+        deps.emplace_back(vm->game_source);
+        fsw::remove_watches(reload_game_code, vm, deps);
+    }
+    for (const auto& dep : deps) {
+        fsw::add_watch(dep, reload_game_code, vm);
+    }
     if (!gc) {
         fmt::println("Could not reload game code");
         return;
     }
+    if (gc == prev) {
+        return;
+    }
     fmt::println("New game code: {}", fmt::ptr(gc));
-    vm->engine_state.game_code = gc;
+    vm->hot_most_recent.game_code = gc;
+}
+
+static void watch_game_code_dependency(void* ctx, const char* path)
+{
+    fsw::add_watch(path, reload_game_code, ctx);
 }
 
-void Vm::init(const char* game_source)
+void Vm::init(const char* game_source, std::optional<uint64_t> seed)
 {
+    gamecode::init();
     engine_state_track = memtrack::track(&engine_state, sizeof(EngineState));
-    rng::init_state(&engine_state.random_state);
+    if (seed) {
+        this->seed = *seed;
+    } else {
+        rng::RandomState seed_state;
+        rng::init_state(&seed_state);
+        this->seed = rng::random(&seed_state);
+    }
+    fmt::println("seed: {} (pass --seed {} to repeat this session)", this->seed, this->seed);
+    rng::init_state(&engine_state.random_state, this->seed);
+    engine_state.random_seed = rng::random(&engine_state.random_state);
 
-    engine_state.game_code = gamecode::load(game_source);
+    this->game_source = game_source;
+    engine_state.game_code = gamecode::load(game_source, nullptr, watch_game_code_dependency, this);
     fsw::add_watch(game_source, reload_game_code, this);
     state = gamecode::load(engine_state.game_code);
     copy_obj(&hot_most_recent, static_cast<HotReloadState*>(&engine_state));
@@ -50,35 +91,121 @@ void Vm::init(const char* game_source)
 
 bool Vm::update()
 {
-    return gamecode::update(engine_state.game_code, state, engine_state.time, engine_state.dt);
+    ensure_restored();
+    reset_frame_arena();
+    const auto broken
+        = gamecode::update(engine_state.game_code, state, engine_state.time, engine_state.dt);
+    if (broken) {
+        handle_break("update");
+    }
+    return broken;
 }
 
 bool Vm::render()
 {
-    return gamecode::render(engine_state.game_code, state);
+    ensure_restored();
+    reset_frame_arena();
+    frame_commands.clear();
+    gfx::set_capture(&frame_commands);
+    const auto broken = gamecode::render(engine_state.game_code, state);
+    gfx::set_capture(nullptr);
+    frame_commands_textures.reset();
+    if (broken) {
+        handle_break("render");
+    } else {
+        frame_commands_textures = gfx::get_texture_generation();
+    }
+    return broken;
+}
+
+bool Vm::render_paused()
+{
+    // seek_timestamp stops in the middle of a frame, which is not what was stored
+    if (!stop_timestamp
+        && drawlists::load(current_frame, gfx::get_texture_generation(), &cached_commands)) {
+        gfx::draw_commands(cached_commands);
+        return false;
+    }
+    const auto broken = render();
+    if (!stop_timestamp) {
+        store_draw_list(current_frame);
+    }
+    return broken;
+}
+
+void Vm::store_draw_list(uint32_t frame_id)
+{
+    if (frame_commands_textures) {
+        drawlists::store(frame_id, frame_commands.data, *frame_commands_textures);
+        frame_commands_textures.reset();
+    }
+}
+
+void Vm::handle_break(const char* callback)
+{
+    const auto info = gamecode::get_break_info();
+    if (info.reason == gamecode::BreakReason::Break) {
+        return; // ng_error sets the error itself
+    }
+
+    const auto loc = gamecode::lookup(info.pc);
+    const auto where = loc.function ? fmt::format(" (in {}+{:#x})", loc.function, loc.offset)
+                                    : std::string(" (outside of game code)");
+    const auto file = loc.file ? loc.file : game_source;
+    if (info.reason == gamecode::BreakReason::Timeout) {
+        error = Error { file, loc.line,
+            fmt::format("{} did not finish within {}ms{}", callback,
+                gamecode::get_watchdog_budget(), where) };
+    } else if (info.reason == gamecode::BreakReason::Fault
+        && memtrack::is_protected(info.fault.address)) {
+        error = Error { file, loc.line,
+            fmt::format("Write to NG_IMMUTABLE memory in {}: address {:#x}{}", callback,
+                info.fault.address, where) };
+    } else if (info.reason == gamecode::BreakReason::Fault) {
+        error = Error { file, loc.line,
+            fmt::format("{} in {}: address {:#x}{}", strsignal(info.fault.signal), callback,
+                info.fault.address, where) };
+    }
+    fmt::println("{}", error->message);
 }
 
 void Vm::update_time(float dt)
 {
+    ensure_restored();
     engine_state.time += dt;
     engine_state.dt = dt;
 }
 
-void Vm::seek(uint32_t frame_id)
+void Vm::restore(uint32_t frame_id)
 {
     memtrack::restore(frame_id);
+    engine_state.textures = hot_most_recent.textures;
+    prune_tilemap_caches();
+    restore_pending = false;
+}
+
+void Vm::seek(uint32_t frame_id)
+{
     current_frame = frame_id;
+    restore_pending = true;
     stop_timestamp.reset();
 }
 
+void Vm::ensure_restored()
+{
+    if (restore_pending) {
+        restore(current_frame);
+    }
+}
+
 void Vm::seek_timestamp(uint64_t ts)
 {
     mode = Mode::Pause;
     const auto frame_id = static_cast<uint32_t>(ts >> 32);
-    memtrack::restore(frame_id);
+    restore(frame_id);
     current_frame = frame_id;
     stop_timestamp = ts;
-    gamecode::update(engine_state.game_code, state, engine_state.time, engine_state.dt);
+    update();
     // Do not reset stop_timestamp, because the stop timestamp might be in render!
 }
 
@@ -89,6 +216,7 @@ void Vm::copy_most_recent_hot_to_current()
 
 void Vm::save_next_frame()
 {
+    ensure_restored();
     current_frame = memtrack::save();
     last_frame = current_frame;
 }
@@ -122,6 +250,7 @@ bool Vm::update_advance(const platform::InputState& input_state, float dt)
 void Vm::finish_frame_advance()
 {
     save_next_frame();
+    store_draw_list(current_frame);
 }
 
 bool Vm::update_replay(float dt)
@@ -139,6 +268,7 @@ void Vm::finish_frame_replay()
     assert(mode == Mode::Replay);
 
     memtrack::overwrite(current_frame);
+    store_draw_list(current_frame);
 
     if (current_frame == last_frame) {
         mode = Vm::Mode::Pause;
@@ -150,7 +280,7 @@ void Vm::finish_frame_replay()
 bool Vm::update_playback()
 {
     assert(mode == Mode::Playback);
-    memtrack::restore(current_frame);
+    restore(current_frame);
     // Update so we lay sounds and stuff
     return update();
 }
@@ -168,6 +298,7 @@ void Vm::finish_frame_playback()
 
 void Vm::start_advance()
 {
+    ensure_restored();
     mode = Vm::Mode::Advance;
     replay_mark.reset();
     stop_timestamp.reset();
@@ -183,6 +314,7 @@ void Vm::start_replay(uint32_t start_frame_id)
 {
     mode = Vm::Mode::Replay;
     seek(start_frame_id);
+    ensure_restored();
     // Overwrite the just restored state with the most recent code
     copy_most_recent_hot_to_current();
     stop_timestamp.reset();
@@ -5,13 +5,16 @@
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <vector>
 
 #include "core.hpp"
 #include "gamecode.hpp"
+#include "gfx.hpp"
 #include "random.hpp"
 
 struct HotReloadState {
-    // This provides a mapping from image handle to texture
+    // This provides a mapping from image handle to texture. The textures in hot_most_recent own a
+    // reference, the ones in the snapshots don't.
     std::array<gfx::Texture*, 16> textures = {};
     GameCode* game_code;
 };
@@ -20,6 +23,7 @@ static_assert(std::is_trivially_copyable_v<HotReloadState>);
 struct EngineState : public HotReloadState {
     platform::InputState input_state;
     rng::RandomState random_state;
+    uint64_t random_seed; // the keys of all random streams are derived from this
     float time;
     float dt;
 };
@@ -36,6 +40,10 @@ struct Vm {
 
     static std::string_view to_string(Mode mode);
 
+    const char* game_source = nullptr;
+    // All randomness in the engine and the game derives from this, so running the same inputs with
+    // the same seed gives the same results.
+    uint64_t seed = 0;
     EngineState engine_state; // The current engine and hot reload state
     uint32_t engine_state_track;
     void* state;
@@ -47,12 +55,28 @@ struct Vm {
     uint32_t next_timestamp_id = 0;
     Mode mode = Mode::Advance;
     std::optional<Error> error;
+    // Seeking only restores once something needs the state, so scrubbing through frames with
+    // stored draw lists doesn't restore at all
+    bool restore_pending = false;
+    // The draws of the last render and the texture generation they are valid for, which is nullopt
+    // if render broke
+    gfx::CommandBuffer frame_commands;
+    std::optional<uint64_t> frame_commands_textures;
+    std::vector<std::byte> cached_commands;
 
-    void init(const char* game_source);
+    // If no seed is passed, a random one is chosen (and printed, so the session can be repeated)
+    void init(const char* game_source, std::optional<uint64_t> seed = std::nullopt);
     bool update();
     bool render();
+    // Draws the stored draw list of the current frame and only renders if there is none
+    bool render_paused();
+    void store_draw_list(uint32_t frame_id);
+    void handle_break(const char* callback);
     void update_time(float dt);
+    // Restores a snapshot, but keeps the most recent textures, because older ones might be freed
+    void restore(uint32_t frame_id);
     void seek(uint32_t frame_id);
+    void ensure_restored();
     void seek_timestamp(uint64_t ts);
     void copy_most_recent_hot_to_current();
     void save_next_frame();